@@ -41,28 +41,38 @@ public:
 		}
 	}
 
-	bool hit(const ray& r, interval& ray_t) const {
-		for (int a = 0; a < 3; a++) {
-			auto invD = 1.0 / r.direction()[a];
-			auto origin = r.origin()[a];
-
-			auto t0 = (axis(a).min - origin) * invD;
-			auto t1 = (axis(a).max - origin) * invD;
-
-			if (invD < 0.0) {
-				std::swap(t0, t1);
-			}
-			if (t0 > ray_t.min) {
-				ray_t.min = t0;
-			}
-			if (t1 < ray_t.max) {
-				ray_t.max = t1;
-			}
-			if (ray_t.max <= ray_t.min) {
-				return false;
-			}
+	//index of the axis with the largest extent (0 = x, 1 = y, 2 = z)
+	int longest_axis() const {
+		if (x.size() > y.size()) {
+			return x.size() > z.size() ? 0 : 2;
+		} else {
+			return y.size() > z.size() ? 1 : 2;
+		}
+	}
+
+	//total area of the 6 faces, used by the SAH cost model (0 for empty boxes)
+	double surface_area() const {
+		double dx = x.size();
+		double dy = y.size();
+		double dz = z.size();
+		if (dx < 0.0 || dy < 0.0 || dz < 0.0) {
+			return 0.0;
 		}
-		return true;
+		return 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	point3 centroid() const {
+		return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+	}
+
+	//slab test, near/far planes are picked by the cached direction signs (no swaps, no divisions)
+	bool hit(const ray& r, interval& ray_t) const {
+		const point3& o = r.origin();
+		const vec3& inv = r.inv_direction();
+		slab(x, o.x(), inv.x(), r.dir_neg[0], ray_t);
+		slab(y, o.y(), inv.y(), r.dir_neg[1], ray_t);
+		slab(z, o.z(), inv.z(), r.dir_neg[2], ray_t);
+		return ray_t.max > ray_t.min;
 	}
 
 	bool is_on_edge(const point3& p, double thickness) const {
@@ -82,6 +92,15 @@ public:
 
 		return false;
 	}
+
+private:
+	//clip ray_t against one axis (NaN from 0 * inf keeps the previous bound)
+	static void slab(const interval& ax, real origin, real inv, int neg, interval& ray_t) {
+		real t0 = ((neg ? ax.max : ax.min) - origin) * inv;
+		real t1 = ((neg ? ax.min : ax.max) - origin) * inv;
+		ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+		ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+	}
 };
 
 //translate bounding box by offset vector
@@ -0,0 +1,1085 @@
+//GUI-free microbenchmarks of the engine internals (run from the repository root so assets/ resolve)
+//usage: zenith_benchmark [all|slab|traversal|packet|build|instancing|triangle|sampling|sampler|precision|wavefront|lights|manylights|environment|sky|hdr]
+
+#include "common.hpp"
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "tlas.hpp"
+#include "triangle_mesh.hpp"
+#include "scene_management.hpp"
+#include "thread_pool.hpp"
+#include "wavefront.hpp"
+#include "stb_image_write.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//seconds elapsed since start
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static ray random_benchmark_ray(double extent) {
+	point3 origin(random_double(-extent, extent), random_double(0.1, 0.4 * extent), random_double(-extent, extent));
+	return ray(origin, random_unit_vector());
+}
+
+//reference: box test as it was before rays cached their inverse direction (divide and swap per axis)
+static bool legacy_slab_hit(const aabb& box, const ray& r, interval ray_t) {
+	for (int a = 0; a < 3; a++) {
+		auto invD = 1.0 / r.direction()[a];
+		auto origin = r.origin()[a];
+
+		auto t0 = (box.axis(a).min - origin) * invD;
+		auto t1 = (box.axis(a).max - origin) * invD;
+
+		if (invD < 0.0) {
+			std::swap(t0, t1);
+		}
+		if (t0 > ray_t.min) {
+			ray_t.min = t0;
+		}
+		if (t1 < ray_t.max) {
+			ray_t.max = t1;
+		}
+		if (ray_t.max <= ray_t.min) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//reference: triangle test as it was before the precomputed watertight version
+//(plane intersection, then three cross products for the inside test and the barycentrics)
+class legacy_triangle : public hittable {
+public:
+	legacy_triangle(const point3& a, const point3& b, const point3& c, const vec3& n0, const vec3& n1, const vec3& n2)
+		: v0(a), v1(b), v2(c), n0(n0), n1(n1), n2(n2)
+	{}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		vec3 normal = cross(v1 - v0, v2 - v0);
+		double normal_length = normal.length();
+		if (normal_length < 1e-8) {
+			return false;
+		}
+		vec3 unit_normal = normal / normal_length;
+		double NdotD = dot(unit_normal, r.direction());
+		if (std::abs(NdotD) < 1e-8) {
+			return false;
+		}
+		double t = (dot(unit_normal, v0) - dot(unit_normal, r.origin())) / NdotD;
+		if (!ray_t.contains(t)) {
+			return false;
+		}
+		point3 p = r.at(t);
+		vec3 C0 = cross(v1 - v0, p - v0);
+		vec3 C1 = cross(v2 - v1, p - v1);
+		vec3 C2 = cross(v0 - v2, p - v2);
+		if (dot(normal, C0) < 0 || dot(normal, C1) < 0 || dot(normal, C2) < 0) {
+			return false;
+		}
+		double area_total_sq = dot(normal, normal);
+		double u = dot(normal, C2) / area_total_sq;
+		double v = dot(normal, C0) / area_total_sq;
+		rec.t = t;
+		rec.p = p;
+		rec.set_face_normal(r, unit_vector((1.0 - u - v) * n0 + u * n1 + v * n2));
+		return true;
+	}
+
+	aabb bounding_box() const override {
+		return triangle(v0, v1, v2, n0, n1, n2, nullptr).bounding_box();
+	}
+
+private:
+	point3 v0, v1, v2;
+	vec3 n0, n1, n2;
+};
+
+//node-visit throughput: one ray against many boxes, legacy vs cached inverse direction
+static void run_slab_benchmark() {
+	const int box_count = 1024;
+	const int ray_count = 4096;
+	const int repeats = 8;
+
+	std::vector<aabb> boxes;
+	for (int i = 0; i < box_count; i++) {
+		point3 p = point3(random_double(-10, 10), random_double(-10, 10), random_double(-10, 10));
+		vec3 size = vec3(random_double(0.1, 2.0), random_double(0.1, 2.0), random_double(0.1, 2.0));
+		boxes.push_back(aabb(p, p + size));
+	}
+	std::vector<ray> rays;
+	for (int i = 0; i < ray_count; i++) {
+		rays.push_back(random_benchmark_ray(15.0));
+	}
+	double tests = static_cast<double>(box_count) * ray_count * repeats;
+
+	size_t legacy_hits = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int k = 0; k < repeats; k++) {
+		for (const ray& r : rays) {
+			for (const aabb& box : boxes) {
+				legacy_hits += legacy_slab_hit(box, r, interval(0.001, infinity));
+			}
+		}
+	}
+	double legacy_time = seconds_since(start);
+
+	size_t cached_hits = 0;
+	start = std::chrono::steady_clock::now();
+	for (int k = 0; k < repeats; k++) {
+		for (const ray& r : rays) {
+			for (const aabb& box : boxes) {
+				interval t(0.001, infinity);
+				cached_hits += box.hit(r, t);
+			}
+		}
+	}
+	double cached_time = seconds_since(start);
+
+	std::printf("[slab] %.0f box tests per variant\n", tests);
+	std::printf("[slab] legacy (divide + swap): %8.1f M tests/s (%zu hits)\n", tests / legacy_time * 1e-6, legacy_hits);
+	std::printf("[slab] cached inverse + signs: %8.1f M tests/s (%zu hits)\n", tests / cached_time * 1e-6, cached_hits);
+	if (legacy_hits != cached_hits) {
+		std::printf("[slab] WARNING: hit counts differ\n");
+	}
+}
+
+//full BVH traversal of the demo scene for every layout
+static void run_traversal_benchmark() {
+	MaterialLibrary mat_lib;
+	load_materials(mat_lib);
+	sceneAssetsLoader assets;
+	hittable_list world = build_geometry(mat_lib, assets, false, 0.0, color(0, 0, 0));
+
+	bvh_node root(world);
+	bvh_stats stats = root.stats();
+	std::printf("[traversal] %zu primitives, %d nodes, SAH build %.2f ms\n", stats.primitive_count, stats.node_count, stats.build_time_ms);
+
+	const int ray_count = 500000;
+	std::vector<ray> rays;
+	for (int i = 0; i < ray_count; i++) {
+		rays.push_back(random_benchmark_ray(15.0));
+	}
+
+	for (int n = 0; n < 3; n++) {
+		bvh_layout layout = static_cast<bvh_layout>(n);
+		auto accelerator = make_bvh_accelerator(root, layout);
+
+		size_t hits = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const ray& r : rays) {
+			hit_record rec;
+			hits += accelerator->hit(r, interval(0.001, infinity), rec);
+		}
+		double time = seconds_since(start);
+		std::printf("[traversal] %-7s %8.2f M rays/s (%zu hits, %s)\n", bvh_layout_name(layout), ray_count / time * 1e-6, hits,
+			layout == bvh_layout::BINARY ? "scalar" : wide_bvh_simd_path);
+	}
+}
+
+//coherent camera rays of the demo scene: single rays vs packets of 4/8/16 (pixel tiles of 2x2, 4x2, 4x4)
+static void run_packet_benchmark() {
+	MaterialLibrary mat_lib;
+	load_materials(mat_lib);
+	sceneAssetsLoader assets;
+	hittable_list world = build_geometry(mat_lib, assets, false, 0.0, color(0, 0, 0));
+
+	const int width = 400;
+	const int height = 225;
+	const point3 eye(10.0, 1.5, 0.0);
+	const interval ray_t(0.001, infinity);
+
+	bvh_layout saved_layout = global_settings::active_bvh_layout;
+	for (int n = 0; n < 3; n++) {
+		global_settings::active_bvh_layout = static_cast<bvh_layout>(n);
+		tlas scene(world);
+
+		for (int packet : { 1, 4, 8, 16 }) {
+			int tile_w = (packet == 4) ? 2 : 4;
+			int tile_h = (packet == 16) ? 4 : 2;
+			size_t hits = 0;
+			double time = 0.0;
+			for (int tile_y = 0; tile_y < height; tile_y += tile_h) {
+				for (int tile_x = 0; tile_x < width; tile_x += tile_w) {
+					ray rays[ray_packet::max_size];
+					hit_record recs[ray_packet::max_size];
+					bool hit[ray_packet::max_size];
+					int count = 0;
+					for (int y = tile_y; y < std::min(height, tile_y + tile_h); y++) {
+						for (int x = tile_x; x < std::min(width, tile_x + tile_w); x++) {
+							vec3 dir(-1.0, 0.27 * (0.5 - (y + 0.5) / height), 0.48 * ((x + 0.5) / width - 0.5));
+							rays[count++] = ray(eye, dir);
+						}
+					}
+
+					auto start = std::chrono::steady_clock::now();
+					if (packet > 1) {
+						scene.hit_packet(rays, count, ray_t, recs, hit);
+					} else {
+						for (int i = 0; i < count; i++) {
+							hit[i] = scene.hit(rays[i], ray_t, recs[i]);
+						}
+					}
+					time += seconds_since(start);
+
+					for (int i = 0; i < count; i++) {
+						hits += hit[i];
+					}
+				}
+			}
+			std::printf("[packet] %-7s %-10s %8.2f M rays/s (%zu hits)\n", bvh_layout_name(global_settings::active_bvh_layout),
+				packet > 1 ? ("packet " + std::to_string(packet)).c_str() : "single", double(width) * height / time * 1e-6, hits);
+		}
+	}
+	global_settings::active_bvh_layout = saved_layout;
+}
+
+//SAH build time of a large random triangle soup (parallel builder)
+static void run_build_benchmark() {
+	const int triangle_count = 500000;
+
+	hittable_list soup;
+	for (int i = 0; i < triangle_count; i++) {
+		point3 a(random_double(-50, 50), random_double(-50, 50), random_double(-50, 50));
+		point3 b = a + vec3(random_double(-0.5, 0.5), random_double(-0.5, 0.5), random_double(-0.5, 0.5));
+		point3 c = a + vec3(random_double(-0.5, 0.5), random_double(-0.5, 0.5), random_double(-0.5, 0.5));
+		vec3 n = unit_vector(cross(b - a, c - a));
+		soup.add(make_shared<triangle>(a, b, c, n, n, n, nullptr));
+	}
+
+	bvh_node root(soup);
+	bvh_stats stats = root.stats();
+	std::printf("[build] %d triangles, %d threads: SAH build %.1f ms (%d nodes, depth %d, SAH cost %.2f)\n", triangle_count,
+		global_thread_pool().size(), stats.build_time_ms, stats.node_count, stats.max_depth, stats.sah_cost);
+
+	auto start = std::chrono::steady_clock::now();
+	auto accelerator = make_bvh_accelerator(root);
+	std::printf("[build] flattened to %s layout in %.1f ms\n", bvh_layout_name(global_settings::active_bvh_layout), seconds_since(start) * 1e3);
+}
+
+//moving instances: top-level refit vs full top-level rebuild on a grid of shared-mesh instances
+static void run_instancing_benchmark() {
+	const int grid = 40;
+	const int moves = 200;
+
+	sceneAssetsLoader assets;
+	hittable_list world;
+	for (int i = 0; i < grid; i++) {
+		for (int j = 0; j < grid; j++) {
+			auto t = affine_transform::translation(vec3(3.0 * (i - grid / 2), 0.0, 3.0 * (j - grid / 2)))
+				* affine_transform::rotation_y(random_double(0.0, 360.0));
+			world.add(make_shared<transform_instance>(assets.teapot, t));
+		}
+	}
+	tlas scene(world);
+	std::printf("[instancing] %zu instances of one mesh, instance size %zu bytes\n", scene.object_count(), sizeof(transform_instance));
+
+	double refit_ms = 0.0;
+	for (int k = 0; k < moves; k++) {
+		size_t index = static_cast<size_t>(random_int(0, static_cast<int>(scene.object_count()) - 1));
+		auto t = affine_transform::translation(vec3(random_double(-60, 60), random_double(0, 2), random_double(-60, 60)));
+		scene.set_instance_transform(index, t);
+		refit_ms += scene.refit_time_ms();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (int k = 0; k < moves; k++) {
+		scene.rebuild();
+	}
+	double rebuild_ms = seconds_since(start) * 1e3;
+
+	std::printf("[instancing] refit:   %8.3f ms per move\n", refit_ms / moves);
+	std::printf("[instancing] rebuild: %8.3f ms per move\n", rebuild_ms / moves);
+}
+
+//rays per second against a loaded mesh: legacy triangles, watertight triangle objects and the indexed mesh
+static void run_mesh_triangle_benchmark(const char* filename) {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename)) {
+		std::printf("[triangle] %s: not found, skipped\n", filename);
+		return;
+	}
+
+	mesh_data data;
+	for (size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+		data.positions.push_back(point3(attrib.vertices[i + 0], attrib.vertices[i + 1], attrib.vertices[i + 2]));
+	}
+	hittable_list legacy_list, triangle_list;
+	for (const auto& shape : shapes) {
+		for (size_t i = 0; i + 2 < shape.mesh.indices.size(); i += 3) {
+			mesh_corner c[3];
+			for (int k = 0; k < 3; k++) {
+				c[k].position = shape.mesh.indices[i + k].vertex_index;
+				data.corners.push_back(c[k]);
+			}
+			const point3& a = data.positions[c[0].position];
+			const point3& b = data.positions[c[1].position];
+			const point3& d = data.positions[c[2].position];
+			vec3 n = unit_vector(cross(b - a, d - a));
+			legacy_list.add(make_shared<legacy_triangle>(a, b, d, n, n, n));
+			triangle_list.add(make_shared<triangle>(a, b, d, n, n, n, nullptr));
+		}
+	}
+
+	auto legacy_mesh = make_bvh_accelerator(bvh_node(legacy_list));
+	auto object_mesh = make_bvh_accelerator(bvh_node(triangle_list));
+	triangle_mesh indexed_mesh(data, nullptr);
+
+	//rays from a sphere around the mesh towards random points inside its box
+	aabb box = indexed_mesh.bounding_box();
+	point3 center = box.centroid();
+	double radius = 2.0 * std::sqrt(box.x.size() * box.x.size() + box.y.size() * box.y.size() + box.z.size() * box.z.size());
+	const int ray_count = 500000;
+	std::vector<ray> rays;
+	for (int i = 0; i < ray_count; i++) {
+		point3 origin = center + radius * random_unit_vector();
+		point3 target(random_double(box.x.min, box.x.max), random_double(box.y.min, box.y.max), random_double(box.z.min, box.z.max));
+		rays.push_back(ray(origin, target - origin));
+	}
+
+	auto trace = [&](const hittable& mesh, size_t& hits) {
+		hits = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const ray& r : rays) {
+			hit_record rec;
+			hits += mesh.hit(r, interval(0.001, infinity), rec);
+		}
+		return ray_count / seconds_since(start) * 1e-6;
+	};
+	size_t legacy_hits, triangle_hits, indexed_hits;
+	double legacy_rate = trace(*legacy_mesh, legacy_hits);
+	double triangle_rate = trace(*object_mesh, triangle_hits);
+	double indexed_rate = trace(indexed_mesh, indexed_hits);
+
+	//one heap object per triangle: the object, the make_shared control block and the list/leaf pointers
+	size_t object_bytes = triangle_list.objects.size() * (sizeof(triangle) + 2 * sizeof(shared_ptr<hittable>) + sizeof(const hittable*));
+	std::printf("[triangle] %s: %zu triangles\n", filename, triangle_list.objects.size());
+	std::printf("[triangle]   legacy:     %8.2f M rays/s (%zu hits)\n", legacy_rate, legacy_hits);
+	std::printf("[triangle]   watertight: %8.2f M rays/s (%zu hits), ~%zu KB of triangle objects\n", triangle_rate, triangle_hits, object_bytes / 1024);
+	std::printf("[triangle]   indexed:    %8.2f M rays/s (%zu hits), %zu KB of vertex/index buffers\n", indexed_rate, indexed_hits, indexed_mesh.memory_bytes() / 1024);
+}
+
+static void run_triangle_benchmark() {
+	run_mesh_triangle_benchmark("assets/models/teapot.obj");
+	run_mesh_triangle_benchmark("assets/models/bowl.obj");
+}
+
+//reference: rejection loops the unit vector and disk samples used before the closed-form mappings
+static vec3 legacy_random_unit_vector() {
+	while (true) {
+		auto p = vec3::random(-1, 1);
+		auto lensq = p.length_squared();
+		if (1e-160 < lensq && lensq <= 1) {
+			return p / sqrt(lensq);
+		}
+	}
+}
+
+static vec3 legacy_random_in_unit_disk() {
+	while (true) {
+		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
+		if (p.length_squared() < 1) {
+			return p;
+		}
+	}
+}
+
+//samples per second of the rejection loops against the closed-form mappings (same PCG32 numbers)
+static void run_sampling_benchmark() {
+	const int samples = 20000000;
+	auto measure = [&](const char* name, auto sample) {
+		vec3 sum(0.0, 0.0, 0.0);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < samples; i++) {
+			sum += sample();
+		}
+		double time = seconds_since(start);
+		std::printf("[sampling] %-28s %8.1f M samples/s (mean length %.4f)\n", name, samples / time * 1e-6, sum.length() / samples);
+	};
+	measure("unit vector, rejection", [] { return legacy_random_unit_vector(); });
+	measure("unit vector, closed form", [] { return random_unit_vector(); });
+	measure("unit disk, rejection", [] { return legacy_random_in_unit_disk(); });
+	measure("unit disk, concentric", [] { return random_in_unit_disk(); });
+	measure("normal + unit vector", [] { return unit_vector(vec3(0, 0, 1) + random_unit_vector()); });
+	measure("cosine hemisphere", [] { return to_normal_frame(cosine_hemisphere_from_uniform(random_double(), random_double()), vec3(0, 0, 1)); });
+}
+
+//reference: the physical sky as camera::get_background_color evaluated it for every escaped ray before it was baked
+static color legacy_physical_sky(const ray& r, const EnvironmentSettings& env) {
+	vec3 unit_dir = unit_vector(r.direction());
+	double sun_height = unit_vector(env.sun_direction).y();
+	double adjusted_height = sun_height - 0.05;
+	double sky_exposure = std::clamp(adjusted_height * 8.0 + 1.4, 0.0, 1.0);
+	double day_factor = std::clamp(adjusted_height * 10.0 + 1.1, 0.0, 1.0);
+	double sunset_intensity = std::clamp(1.0 - std::abs(adjusted_height + 0.05) * 30.0, 0.0, 1.0);
+	double sunset_factor = (adjusted_height > -0.1) ? sunset_intensity : 0.0;
+	if (sun_height < 0) {
+		sunset_factor *= (sun_height * 10.0 + 1.0);
+	}
+	sunset_factor = std::clamp(sunset_factor, 0.0, 1.0);
+
+	color zenit_color = color(0.01, 0.03, 0.1) * (1.0 - day_factor) + color(0.2, 0.5, 1.0) * day_factor;
+	color horizon_color = color(0.05, 0.02, 0.01) * (1.0 - day_factor) + color(0.6, 0.8, 1.0) * day_factor;
+	horizon_color = horizon_color * (1.0 - sunset_factor) + color(1.0, 0.35, 0.1) * sunset_factor;
+	auto a = unit_dir.y();
+	color sky_color = (a > 0.0) ? (1.0 - a) * horizon_color + a * zenit_color : horizon_color * 0.1;
+	color final_color = sky_color * (env.intensity * 1.5) * sky_exposure;
+
+	if (adjusted_height > -0.1) {
+		vec3 sun_dir = unit_vector(env.sun_direction);
+		double sun_focus = dot(unit_dir, sun_dir);
+		double sun_threshold = 1.0 - (env.sun_size * 0.001);
+		if (sun_focus > sun_threshold) {
+			color s_color = env.sun_color * (1.0 - sunset_factor) + color(1.0, 0.3, 0.1) * sunset_factor;
+			double visibility = std::clamp(sun_dir.y() * 5.0 + 1.0, 0.0, 1.0);
+			double alpha = smoothstep(sun_threshold, sun_threshold + 0.0002, sun_focus);
+			final_color += s_color * env.sun_intensity * visibility * alpha;
+		}
+	}
+	return final_color;
+}
+
+//escaped-ray shading of the physical sun mode: full evaluation per ray against the per-render baked sky
+static void run_sky_benchmark() {
+	const int lookups = 20000000;
+	const int direction_count = 4096;
+	std::vector<ray> rays(direction_count);
+	pcg32 rng(5, 1);
+	EnvironmentSettings env;
+	for (int n = 0; n < direction_count; n++) {
+		//a quarter of the rays point into a 10x enlarged sun, so the disc branch is measured too
+		vec3 dir = random_unit_vector();
+		if (n % 4 == 0) {
+			dir = unit_vector(env.sun_direction) + 0.04 * dir;
+		}
+		rays[n] = ray(point3(0, 0, 0), dir * (0.5 + rng.next_double()));
+	}
+	for (double height : { 0.5, 0.03 }) {
+		env.sun_direction = vec3(0.8, height, -0.5);
+		env.sun_size = 10.0;
+		const char* name = (height > 0.1) ? "day" : "sunset";
+
+		double max_difference = 0.0;
+		for (const ray& r : rays) {
+			color d = legacy_physical_sky(r, env) - physical_sky(env).radiance(unit_vector(r.direction()));
+			max_difference = std::max(max_difference, static_cast<double>(std::max({ std::abs(d.x()), std::abs(d.y()), std::abs(d.z()) })));
+		}
+
+		color sum(0.0, 0.0, 0.0);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < lookups; i++) {
+			sum += legacy_physical_sky(rays[i & (direction_count - 1)], env);
+		}
+		double legacy_time = seconds_since(start);
+
+		start = std::chrono::steady_clock::now();
+		physical_sky sky(env);
+		for (int i = 0; i < lookups; i++) {
+			sum += sky.radiance(unit_vector(rays[i & (direction_count - 1)].direction()));
+		}
+		double baked_time = seconds_since(start);
+		std::printf("[sky] %-6s per-ray evaluation %6.1f M/s, baked %6.1f M/s (%.2fx), max difference %.2g (checksum %.3f)\n", name,
+			lookups / legacy_time * 1e-6, lookups / baked_time * 1e-6, legacy_time / baked_time, max_difference, sum.length() / lookups);
+	}
+}
+
+//small path-traced scene of the sampler and precision benchmarks (ground, glass, diffuse and metal spheres)
+class sphere_test_scene {
+public:
+	static constexpr int width = 96;
+	static constexpr int height = 54;
+
+	sphere_test_scene() {
+		load_materials(mat_lib);
+		hittable_list world;
+		world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, mat_lib.get("white_diffuse")));
+		world.add(make_shared<sphere>(point3(0, 1, 0), 1, mat_lib.get("glass")));
+		world.add(make_shared<sphere>(point3(0, 1, 2.2), 1, mat_lib.get("red_diffuse")));
+		world.add(make_shared<sphere>(point3(0, 1, -2.2), 1, mat_lib.get("rough_gold")));
+		scene = make_shared<bvh_node>(world);
+	}
+
+	//path tracer with a sky gradient, the sampler feeds the pixel jitter and every scatter; returns the rays traced
+	long long render(sampler_type type, int spp, std::vector<color>& image) const {
+		const point3 eye(10.0, 1.5, 0.0);
+		std::atomic<long long> rays = 0;
+		image.assign(static_cast<size_t>(width) * height, color(0.0, 0.0, 0.0));
+		global_thread_pool().parallel_for(height, [&](int y) {
+			long long row_rays = 0;
+			for (int x = 0; x < width; x++) {
+				color sum(0.0, 0.0, 0.0);
+				for (int s = 0; s < spp; s++) {
+					seed_thread_rng(static_cast<uint64_t>(y) * width + x, s, 0);
+					thread_sampler().start(type, x, y, s, spp, 0);
+					double u, v;
+					thread_sampler().get_2d(u, v);
+					vec3 dir(-1.0, 0.27 * (0.5 - (y + v) / height), 0.48 * ((x + u) / width - 0.5));
+					sum += radiance(ray(eye, dir), row_rays);
+				}
+				image[static_cast<size_t>(y) * width + x] = sum / spp;
+			}
+			rays.fetch_add(row_rays);
+		}, 1);
+		return rays.load();
+	}
+
+	//the same paths through the wavefront stages, one queue per image row; returns the rays traced
+	long long render_wavefront(sampler_type type, int spp, std::vector<color>& image) const {
+		const point3 eye(10.0, 1.5, 0.0);
+		std::atomic<long long> rays = 0;
+		image.assign(static_cast<size_t>(width) * height, color(0.0, 0.0, 0.0));
+		wavefront_integrator integrator;
+		integrator.max_depth = 8;
+		global_thread_pool().parallel_for(height, [&](int y) {
+			path_queue paths;
+			for (int x = 0; x < width; x++) {
+				for (int s = 0; s < spp; s++) {
+					seed_thread_rng(static_cast<uint64_t>(y) * width + x, s, 0);
+					thread_sampler().start(type, x, y, s, spp, 0);
+					double u, v;
+					thread_sampler().get_2d(u, v);
+					vec3 dir(-1.0, 0.27 * (0.5 - (y + v) / height), 0.48 * ((x + u) / width - 0.5));
+					paths.add(ray(eye, dir), x);
+				}
+			}
+			rays.fetch_add(integrator.trace(*scene, paths, [](const ray& r, double) { return sky(r); }));
+			for (int p = 0; p < paths.size(); p++) {
+				image[static_cast<size_t>(y) * width + paths.owners[p]] += paths.radiance[p] / spp;
+			}
+		}, 1);
+		return rays.load();
+	}
+
+private:
+	MaterialLibrary mat_lib;
+	shared_ptr<bvh_node> scene;
+
+	static color sky(const ray& r) {
+		double t = 0.5 * (unit_vector(r.direction()).y() + 1.0);
+		return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
+	}
+
+	color radiance(ray r, long long& rays) const {
+		const interval ray_t(0.001, infinity);
+		color throughput(1.0, 1.0, 1.0);
+		for (int depth = 0; depth < 8; depth++) {
+			hit_record rec;
+			rays++;
+			if (!scene->hit(r, ray_t, rec)) {
+				return throughput * sky(r);
+			}
+			color attenuation;
+			ray scattered;
+			if (!rec.mat->scatter(r, rec, attenuation, scattered)) {
+				break;
+			}
+			throughput = throughput * attenuation;
+			r = scattered;
+		}
+		return color(0.0, 0.0, 0.0);
+	}
+};
+
+//image error of every sampler against a high-spp reference at equal sample counts
+static void run_sampler_benchmark() {
+	sphere_test_scene test_scene;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<color> reference;
+	const int reference_spp = 4096;
+	test_scene.render(sampler_type::SOBOL, reference_spp, reference);
+	std::printf("[sampler] reference: %d spp in %.2f s (%dx%d)\n", reference_spp, seconds_since(start),
+		sphere_test_scene::width, sphere_test_scene::height);
+
+	std::vector<color> image;
+	for (int n = 0; n < 4; n++) {
+		sampler_type type = static_cast<sampler_type>(n);
+		for (int spp : { 4, 16, 64 }) {
+			start = std::chrono::steady_clock::now();
+			test_scene.render(type, spp, image);
+			double time = seconds_since(start);
+			double error = 0.0;
+			for (size_t i = 0; i < image.size(); i++) {
+				error += (image[i] - reference[i]).length_squared() / 3.0;
+			}
+			std::printf("[sampler] %-10s %3d spp: RMSE %.5f in %7.1f ms\n", sampler_name(type), spp, std::sqrt(error / image.size()), time * 1e3);
+		}
+	}
+}
+
+//scene lit by small emissive boxes (rotated and stretched instances, like the neon boxes of the demo scene)
+//and the environment (night sky with an optional sun disc, or an HDR map), rendered by the wavefront integrator
+//with and without next-event estimation; the boxes cover a field that grows with their count (same density for any count)
+class light_test_scene {
+public:
+	static constexpr int width = 96;
+	static constexpr int height = 54;
+
+	light_test_scene(int light_count, const EnvironmentSettings& environment, double light_size = 1.0)
+		: env(environment)
+	{
+		hittable_list world;
+		world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(color(0.7, 0.7, 0.7))));
+		world.add(make_shared<sphere>(point3(0, 1, 0), 1, make_shared<lambertian>(color(0.8, 0.3, 0.2))));
+		world.add(make_shared<sphere>(point3(0, 1, 2.2), 1, make_shared<dielectric>(1.5)));
+		world.add(make_shared<sphere>(point3(0, 1, -2.2), 1, make_shared<metal>(color(0.9, 0.8, 0.5), 0.2)));
+		auto box = make_shared<cube>(point3(-0.2, -0.2, -0.2), point3(0.2, 0.2, 0.2), nullptr);
+		pcg32 rng(7, 3);
+		double field = std::sqrt(light_count / 60.0);
+		for (int n = 0; n < light_count; n++) {
+			point3 center(-3.0 - 9.0 * field * rng.next_double(), 0.2, 8.0 * field * (2.0 * rng.next_double() - 1.0));
+			color emission = color(0.2 + rng.next_double(), 0.2 + rng.next_double(), 0.2 + rng.next_double()) * (4.0 / (light_size * light_size));
+			affine_transform object_to_world = affine_transform::translation(center)
+				* affine_transform::rotation_y(90.0 * rng.next_double())
+				* affine_transform::scaling(vec3(0.4, 1.5 + 3.0 * rng.next_double(), 0.4) * light_size);
+			world.add(make_shared<transform_instance>(box, object_to_world, make_shared<diffuse_light>(emission)));
+		}
+		auto start = std::chrono::steady_clock::now();
+		lights.build(world);
+		light_build_time = seconds_since(start);
+		lights.set_environment(env);
+		sky = physical_sky(env);
+		hdr_background = hdr_environment(env);
+		scene = make_shared<bvh_node>(world);
+	}
+
+	size_t light_count() const {
+		return lights.object_count();
+	}
+
+	double light_build_seconds() const {
+		return light_build_time;
+	}
+
+	void select_lights(light_selection selection) {
+		lights.selection = selection;
+	}
+
+	//mean and standard deviation of the unweighted one-sample direct light estimate (luminance) on the ground below p
+	void direct_light_spread(const point3& p, int samples, double& mean, double& deviation) const {
+		hit_record rec;
+		ray down(point3(p.x(), 1.0, p.z()), vec3(0, -1, 0));
+		scene->hit(down, interval(0.001, infinity), rec);
+		double sum = 0.0;
+		double sum_sq = 0.0;
+		for (int s = 0; s < samples; s++) {
+			seed_thread_rng(s, 0, 0);
+			thread_sampler().start(sampler_type::RANDOM, 0, 0, s, samples, 0);
+			light_sample ls;
+			double value = 0.0;
+			double cos_theta = 0.0;
+			if (lights.sample(rec.p, ls) && (cos_theta = dot(rec.normal, ls.direction)) > 0.0) {
+				hit_record blocker;
+				ray shadow(rec.p + ray_epsilon * rec.normal, ls.direction);
+				if (!scene->hit(shadow, interval(0.001, ls.distance * (1.0 - 1e-4)), blocker)) {
+					value = ls.radiance.luminance() * 0.7 * cos_theta / (pi * ls.pdf);
+				}
+			}
+			sum += value;
+			sum_sq += value * value;
+		}
+		mean = sum / samples;
+		deviation = std::sqrt(std::max(0.0, sum_sq / samples - mean * mean));
+	}
+
+	//returns the rays traced (camera and bounce rays)
+	long long render(bool sample_lights, int spp, std::vector<color>& image) const {
+		const point3 eye(10.0, 1.5, 0.0);
+		std::atomic<long long> rays = 0;
+		image.assign(static_cast<size_t>(width) * height, color(0.0, 0.0, 0.0));
+		wavefront_integrator integrator;
+		integrator.max_depth = 8;
+		integrator.lights = sample_lights ? &lights : nullptr;
+		auto background = [&](const ray& r, double mis_weight) {
+			vec3 d = unit_vector(r.direction());
+			if (env.mode() == EnvironmentSettings::HDR_MAP) {
+				return hdr_background.radiance(d) * mis_weight;
+			}
+			return color(0.01, 0.01, 0.02) + sky.sun_disc(d) * mis_weight;
+		};
+		global_thread_pool().parallel_for(height, [&](int y) {
+			path_queue paths;
+			for (int x = 0; x < width; x++) {
+				for (int s = 0; s < spp; s++) {
+					seed_thread_rng(static_cast<uint64_t>(y) * width + x, s, 0);
+					thread_sampler().start(sampler_type::SOBOL, x, y, s, spp, 0);
+					double u, v;
+					thread_sampler().get_2d(u, v);
+					vec3 dir(-1.0, 0.27 * (0.5 - (y + v) / height), 0.48 * ((x + u) / width - 0.5));
+					paths.add(ray(eye, dir), x);
+				}
+			}
+			rays.fetch_add(integrator.trace(*scene, paths, background));
+			for (int p = 0; p < paths.size(); p++) {
+				image[static_cast<size_t>(y) * width + paths.owners[p]] += paths.radiance[p] / spp;
+			}
+		}, 1);
+		return rays.load();
+	}
+
+private:
+	shared_ptr<bvh_node> scene;
+	scene_lights lights;
+	EnvironmentSettings env;
+	physical_sky sky;
+	hdr_environment hdr_background;
+	double light_build_time = 0.0;
+};
+
+//physical sun low over the horizon (intensity 0 = night sky only)
+static EnvironmentSettings low_sun(double intensity) {
+	EnvironmentSettings env;
+	env.sun_direction = unit_vector(vec3(1.0, 0.25, -0.5));
+	env.sun_intensity = intensity;
+	return env;
+}
+
+//RMSE after a Reinhard curve, bright emitters or a sun seen directly would dominate a linear error
+static double tonemapped_rmse(const std::vector<color>& image, const std::vector<color>& reference) {
+	double error = 0.0;
+	for (size_t i = 0; i < image.size(); i++) {
+		for (int c = 0; c < 3; c++) {
+			double d = image[i][c] / (1.0 + image[i][c]) - reference[i][c] / (1.0 + reference[i][c]);
+			error += d * d / 3.0;
+		}
+	}
+	return std::sqrt(error / image.size());
+}
+
+//image error of BSDF-only path tracing and of next-event estimation (light sampling + MIS) at equal sample counts
+static void run_lights_benchmark() {
+	light_test_scene test_scene(60, low_sun(20.0));
+	auto start = std::chrono::steady_clock::now();
+	std::vector<color> reference;
+	const int reference_spp = 1024;
+	test_scene.render(true, reference_spp, reference);
+	std::printf("[lights] %zu emissive boxes + sun, reference: %d spp with light sampling in %.2f s\n",
+		test_scene.light_count(), reference_spp, seconds_since(start));
+
+	auto mean_luminance = [](const std::vector<color>& image) {
+		double sum = 0.0;
+		for (const color& c : image) {
+			sum += c.luminance();
+		}
+		return sum / image.size();
+	};
+	std::vector<color> image;
+	for (int mode = 0; mode < 2; mode++) {
+		for (int spp : { 4, 16, 64, 256 }) {
+			start = std::chrono::steady_clock::now();
+			test_scene.render(mode == 1, spp, image);
+			double time = seconds_since(start);
+			double error = 0.0;
+			for (size_t i = 0; i < image.size(); i++) {
+				error += (image[i] - reference[i]).length_squared() / 3.0;
+			}
+			std::printf("[lights] %-15s %3d spp: RMSE %.5f, mean %.5f (reference %.5f) in %7.1f ms\n", mode == 1 ? "light sampling" : "BSDF only",
+				spp, std::sqrt(error / image.size()), mean_luminance(image), mean_luminance(reference), time * 1e3);
+		}
+	}
+}
+
+//light selection by power only (alias table) against the light BVH, with 10k emissive boxes
+static void run_many_lights_benchmark() {
+	light_test_scene test_scene(10000, low_sun(0.0), 0.25);
+	std::printf("[many lights] %zu emissive boxes, selection structures built in %.1f ms\n",
+		test_scene.light_count(), test_scene.light_build_seconds() * 1e3);
+	for (int n = 0; n < 2; n++) {
+		light_selection selection = static_cast<light_selection>(n);
+		test_scene.select_lights(selection);
+		for (point3 p : { point3(-10.0, 0.0, 0.0), point3(-60.0, 0.0, 30.0) }) {
+			double mean, deviation;
+			auto start = std::chrono::steady_clock::now();
+			test_scene.direct_light_spread(p, 200000, mean, deviation);
+			std::printf("[many lights] %-9s direct light at (%g, %g): mean %.4f, std dev %.3f, %.0f ns per sample\n", light_selection_name(selection),
+				p.x(), p.z(), mean, deviation, seconds_since(start) * 1e9 / 200000);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<color> reference;
+	const int reference_spp = 512;
+	test_scene.select_lights(light_selection::SPATIAL);
+	test_scene.render(true, reference_spp, reference);
+	std::printf("[many lights] reference: %d spp with the light BVH in %.2f s\n", reference_spp, seconds_since(start));
+
+	std::vector<color> image;
+	for (int n = 0; n < 2; n++) {
+		light_selection selection = static_cast<light_selection>(n);
+		test_scene.select_lights(selection);
+		for (int spp : { 4, 16, 64 }) {
+			start = std::chrono::steady_clock::now();
+			test_scene.render(true, spp, image);
+			double time = seconds_since(start);
+			std::printf("[many lights] %-9s %2d spp: RMSE %.5f in %7.1f ms\n", light_selection_name(selection),
+				spp, tonemapped_rmse(image, reference), time * 1e3);
+		}
+	}
+}
+
+//synthetic equirect sky with a small, very bright sun baked in, written to a temporary .hdr file (returns the path)
+static std::string write_test_hdr(int map_width, int map_height) {
+	const vec3 sun = unit_vector(vec3(0.3, 0.6, -0.7));
+	std::vector<float> pixels(static_cast<size_t>(map_width) * map_height * 3);
+	for (int j = 0; j < map_height; j++) {
+		for (int i = 0; i < map_width; i++) {
+			double theta = pi * (j + 0.5) / map_height;
+			double phi = 2.0 * pi * (i + 0.5) / map_width - pi;
+			vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			double sun_disc = (dot(d, sun) > 0.9995) ? 20000.0 : 0.0;
+			float* pixel = &pixels[(static_cast<size_t>(j) * map_width + i) * 3];
+			pixel[0] = static_cast<float>(0.3 + sun_disc);
+			pixel[1] = static_cast<float>(0.4 + sun_disc);
+			pixel[2] = static_cast<float>(0.6 * (0.5 + 0.5 * d.y()) + sun_disc);
+		}
+	}
+	std::string path = (std::filesystem::temp_directory_path() / "zenith_benchmark_sky.hdr").string();
+	stbi_write_hdr(path.c_str(), map_width, map_height, 3, pixels.data());
+	return path;
+}
+
+//HDR environment: load and CDF build time, cached reload time, and image error with and without sampling the map
+static void run_environment_benchmark() {
+	const int map_width = 1024;
+	const int map_height = 512;
+	std::string path = write_test_hdr(map_width, map_height);
+
+	EnvironmentSettings env;
+	auto start = std::chrono::steady_clock::now();
+	env.load_hdr(path);
+	double load_time = seconds_since(start);
+	env.load_hdr("");
+	start = std::chrono::steady_clock::now();
+	env.load_hdr(path);
+	double cached_time = seconds_since(start);
+	std::printf("[environment] %dx%d map: load + CDF %.1f ms (%.1f MB of CDFs), cached reload %.3f ms\n", map_width, map_height,
+		load_time * 1e3, env.hdr_distribution->memory_size() / (1024.0 * 1024.0), cached_time * 1e3);
+	env.hdri_rotation = 2.0; //turn the sun behind the camera, the sampling follows the rotation
+
+	light_test_scene test_scene(0, env);
+	std::vector<color> reference;
+	const int reference_spp = 1024;
+	start = std::chrono::steady_clock::now();
+	test_scene.render(true, reference_spp, reference);
+	std::printf("[environment] reference: %d spp with map sampling in %.2f s\n", reference_spp, seconds_since(start));
+
+	std::vector<color> image;
+	for (int mode = 0; mode < 2; mode++) {
+		for (int spp : { 4, 16, 64 }) {
+			start = std::chrono::steady_clock::now();
+			test_scene.render(mode == 1, spp, image);
+			double time = seconds_since(start);
+			std::printf("[environment] %-12s %2d spp: RMSE %.5f in %7.1f ms\n", mode == 1 ? "map sampling" : "BSDF only",
+				spp, tonemapped_rmse(image, reference), time * 1e3);
+		}
+	}
+	std::filesystem::remove(path);
+}
+
+//reference: the HDR lookup as camera::get_background_color did it for every escaped ray before the rotation was cached
+static color legacy_hdr_radiance(const ray& r, const EnvironmentSettings& env) {
+	vec3 d = unit_vector(r.direction());
+	double cos_y = cos(env.hdri_rotation);
+	double sin_y = sin(env.hdri_rotation);
+	d = vec3(cos_y * d.x() + sin_y * d.z(), d.y(), -sin_y * d.x() + cos_y * d.z());
+	double cos_p = cos(env.hdri_tilt);
+	double sin_p = sin(env.hdri_tilt);
+	d = vec3(d.x(), cos_p * d.y() - sin_p * d.z(), sin_p * d.y() + cos_p * d.z());
+	double cos_r = cos(env.hdri_roll);
+	double sin_r = sin(env.hdri_roll);
+	d = vec3(cos_r * d.x() - sin_r * d.y(), sin_r * d.x() + cos_r * d.y(), d.z());
+	auto phi = atan2(d.z(), d.x()) + pi;
+	auto theta = acos(std::clamp<double>(d.y(), -1.0, 1.0));
+	return env.hdr_texture->value(phi / (2 * pi), theta / pi, point3(0.0, 0.0, 0.0)) * env.intensity;
+}
+
+//escaped-ray shading of the HDR mode: per-ray trig and libm atan2/acos against the cached rotation matrix
+//and the polynomial mapping, plus how many lookups land in a different pixel of a 4k map
+static void run_hdr_lookup_benchmark() {
+	const int map_width = 4096;
+	const int map_height = 2048;
+	std::string path = write_test_hdr(map_width, map_height);
+	EnvironmentSettings env;
+	env.load_hdr(path);
+	env.hdri_rotation = 0.7;
+	env.hdri_tilt = 0.3;
+	env.hdri_roll = -0.2;
+
+	const int lookups = 20000000;
+	const int direction_count = 4096;
+	std::vector<ray> rays(direction_count);
+	for (ray& r : rays) {
+		r = ray(point3(0, 0, 0), random_unit_vector() * (0.5 + random_double()));
+	}
+
+	color sum(0.0, 0.0, 0.0);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < lookups; i++) {
+		sum += legacy_hdr_radiance(rays[i & (direction_count - 1)], env);
+	}
+	double legacy_time = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	hdr_environment hdr(env);
+	for (int i = 0; i < lookups; i++) {
+		sum += hdr.radiance(unit_vector(rays[i & (direction_count - 1)].direction()));
+	}
+	double baked_time = seconds_since(start);
+
+	//pixel agreement of the mappings over many directions
+	const int checks = 4000000;
+	int moved = 0;
+	double max_error = 0.0;
+	for (int n = 0; n < checks; n++) {
+		vec3 d = random_unit_vector();
+		double u = (atan2(d.z(), d.x()) + pi) / (2 * pi);
+		double v = acos(std::clamp<double>(d.y(), -1.0, 1.0)) / pi;
+		double fast_u, fast_v;
+		hdr_environment::map_uv(d, fast_u, fast_v);
+		max_error = std::max({ max_error, std::abs(u - fast_u) * map_width, std::abs(v - fast_v) * map_height });
+		bool same_pixel = std::min(static_cast<int>(u * map_width), map_width - 1) == std::min(static_cast<int>(fast_u * map_width), map_width - 1)
+			&& std::min(static_cast<int>(v * map_height), map_height - 1) == std::min(static_cast<int>(fast_v * map_height), map_height - 1);
+		moved += same_pixel ? 0 : 1;
+	}
+	std::printf("[hdr lookup] per-ray trig %6.1f M/s, cached rotation %6.1f M/s (%.2fx), checksum %.3f\n",
+		lookups / legacy_time * 1e-6, lookups / baked_time * 1e-6, legacy_time / baked_time, sum.length() / lookups);
+	std::printf("[hdr lookup] %dx%d map: max mapping error %.4f pixels, %.4f%% of lookups in a neighbouring pixel\n",
+		map_width, map_height, max_error, 100.0 * moved / checks);
+	std::filesystem::remove(path);
+}
+
+//one path at a time (megakernel) against the wavefront stages on the same paths, the images must match
+static void run_wavefront_benchmark() {
+	sphere_test_scene test_scene;
+	std::vector<color> megakernel_image;
+	std::vector<color> wavefront_image;
+	for (int spp : { 16, 64 }) {
+		auto start = std::chrono::steady_clock::now();
+		long long rays = test_scene.render(sampler_type::SOBOL, spp, megakernel_image);
+		double time = seconds_since(start);
+		std::printf("[wavefront] megakernel %3d spp: %.2f M rays/s\n", spp, rays / time * 1e-6);
+
+		start = std::chrono::steady_clock::now();
+		rays = test_scene.render_wavefront(sampler_type::SOBOL, spp, wavefront_image);
+		time = seconds_since(start);
+		double max_difference = 0.0;
+		for (size_t i = 0; i < wavefront_image.size(); i++) {
+			for (int c = 0; c < 3; c++) {
+				max_difference = std::max(max_difference, std::fabs(double(wavefront_image[i][c] - megakernel_image[i][c])));
+			}
+		}
+		std::printf("[wavefront] wavefront  %3d spp: %.2f M rays/s (max difference %.2g)\n", spp, rays / time * 1e-6, max_difference);
+	}
+}
+
+//path tracing throughput and memory of this build's scalar type (zenith_benchmark = double, zenith_benchmark_float = float);
+//the image is saved, so the run of the other build prints the difference between the two
+static void run_precision_benchmark() {
+	const char* name = sizeof(real) == sizeof(float) ? "float" : "double";
+	const char* other = sizeof(real) == sizeof(float) ? "double" : "float";
+	std::printf("[precision] %s build: vec3 %zu bytes, ray %zu bytes, hit_record %zu bytes\n", name, sizeof(vec3), sizeof(ray), sizeof(hit_record));
+	//8 per-pixel color buffers in the camera (beauty, denoise, albedo, normals, reflections, refractions, z-depth, heatmap)
+	std::printf("[precision] camera buffers: %zu bytes per pixel, %.1f MB at 1920x1080\n", 8 * sizeof(color), 8.0 * sizeof(color) * 1920 * 1080 / 1048576.0);
+
+	sphere_test_scene test_scene;
+	std::vector<color> image;
+	auto start = std::chrono::steady_clock::now();
+	long long rays = test_scene.render(sampler_type::SOBOL, 256, image);
+	double time = seconds_since(start);
+	std::printf("[precision] %d spp: %.2f M rays/s\n", 256, rays / time * 1e-6);
+
+	//saved as float triples in both builds
+	std::filesystem::create_directories("output");
+	std::string path = std::string("output/benchmark_precision_") + name + ".bin";
+	if (FILE* f = std::fopen(path.c_str(), "wb")) {
+		for (const color& c : image) {
+			float rgb[3] = { static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z()) };
+			std::fwrite(rgb, sizeof(float), 3, f);
+		}
+		std::fclose(f);
+	}
+
+	std::string other_path = std::string("output/benchmark_precision_") + other + ".bin";
+	FILE* f = std::fopen(other_path.c_str(), "rb");
+	if (!f) {
+		std::printf("[precision] run the %s build as well to compare the images\n", other);
+		return;
+	}
+	double error = 0.0;
+	double max_difference = 0.0;
+	size_t values = 0;
+	for (const color& c : image) {
+		float rgb[3];
+		if (std::fread(rgb, sizeof(float), 3, f) != 3) {
+			break;
+		}
+		for (int i = 0; i < 3; i++) {
+			double d = c[i] - rgb[i];
+			error += d * d;
+			max_difference = std::max(max_difference, std::fabs(d));
+			values++;
+		}
+	}
+	std::fclose(f);
+	std::printf("[precision] difference to the %s image: RMSE %.6f, max %.6f\n", other, std::sqrt(error / std::max<size_t>(values, 1)), max_difference);
+}
+
+int main(int argc, char** argv) {
+	const char* which = (argc > 1) ? argv[1] : "all";
+	bool all = std::strcmp(which, "all") == 0;
+
+	if (all || std::strcmp(which, "slab") == 0) {
+		run_slab_benchmark();
+	}
+	if (all || std::strcmp(which, "traversal") == 0) {
+		run_traversal_benchmark();
+	}
+	if (all || std::strcmp(which, "packet") == 0) {
+		run_packet_benchmark();
+	}
+	if (all || std::strcmp(which, "build") == 0) {
+		run_build_benchmark();
+	}
+	if (all || std::strcmp(which, "instancing") == 0) {
+		run_instancing_benchmark();
+	}
+	if (all || std::strcmp(which, "triangle") == 0) {
+		run_triangle_benchmark();
+	}
+	if (all || std::strcmp(which, "sampling") == 0) {
+		run_sampling_benchmark();
+	}
+	if (all || std::strcmp(which, "sampler") == 0) {
+		run_sampler_benchmark();
+	}
+	if (all || std::strcmp(which, "precision") == 0) {
+		run_precision_benchmark();
+	}
+	if (all || std::strcmp(which, "wavefront") == 0) {
+		run_wavefront_benchmark();
+	}
+	if (all || std::strcmp(which, "lights") == 0) {
+		run_lights_benchmark();
+	}
+	if (all || std::strcmp(which, "manylights") == 0) {
+		run_many_lights_benchmark();
+	}
+	if (all || std::strcmp(which, "environment") == 0) {
+		run_environment_benchmark();
+	}
+	if (all || std::strcmp(which, "sky") == 0) {
+		run_sky_benchmark();
+	}
+	if (all || std::strcmp(which, "hdr") == 0) {
+		run_hdr_lookup_benchmark();
+	}
+	return 0;
+}
\ No newline at end of file
@@ -1,10 +1,284 @@
 ﻿#pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
 
 #include "common.hpp"
 #include "hittable.hpp"
 #include "hittable_list.hpp"
+#include "material.hpp"
+#include "thread_pool.hpp"
+
+//SIMD slab tests of the wide nodes and ray packets
+//x86-64 always has SSE2, AVX is only used when the compiler is allowed to emit it (-mavx2 / /arch:AVX2)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define ZENITH_WIDE_BVH_SSE 1
+	#include <immintrin.h>
+#endif
+#if defined(ZENITH_WIDE_BVH_SSE) && defined(__AVX__)
+	#define ZENITH_WIDE_BVH_AVX 1
+#endif
+
+//primitive record used during the build (bounds, centroid and index into the object list)
+struct bvh_primitive {
+	aabb box;
+	point3 centroid;
+	size_t index = 0;
+};
+
+//summary of a built tree (shown in the Engine Info panel to compare trees)
+struct bvh_stats {
+	double sah_cost = 0.0; //expected cost of a random ray relative to the root box
+	int node_count = 0;
+	int leaf_count = 0;
+	int max_depth = 0;
+	size_t primitive_count = 0;
+	double build_time_ms = 0.0; //wall time of the SAH build
+};
+
+//binned Surface Area Heuristic
+namespace bvh_sah {
+	//relative cost of one node visit and one primitive intersection
+	constexpr double traversal_cost = 1.0;
+	constexpr double intersection_cost = 1.0;
+	constexpr int max_bins = 64;
+
+	//nodes with at least this many primitives are binned by all cores, smaller subtrees are built one per core
+	constexpr size_t parallel_threshold = 4096;
+
+	struct split {
+		int axis = -1; //-1 means "make a leaf"
+		size_t mid = 0; //first primitive of the right child after partitioning
+		double cost = infinity;
+	};
+
+	struct bin {
+		aabb box;
+		size_t count = 0;
+	};
+
+	//bins of all 3 axes
+	struct bin_set {
+		bin bins[3][max_bins];
+	};
+
+	//number of chunks prims[start, end) is split into for parallel passes (1 = serial)
+	inline int chunk_count(size_t count, bool parallel) {
+		if (!parallel || count < parallel_threshold) {
+			return 1;
+		}
+		return static_cast<int>(std::min<size_t>(64, count / (parallel_threshold / 4)));
+	}
+
+	//finds the cheapest bin boundary over all 3 axes and partitions prims[start, end) around it
+	//fully deterministic: no randomness, ties resolved by axis and bin order (also when binned in parallel)
+	inline split find_and_partition(std::vector<bvh_primitive>& prims, size_t start, size_t end,
+		const aabb& bounds, int bin_count, int max_leaf_size, bool parallel = false) {
+
+		split best;
+		size_t count = end - start;
+		if (count <= 1) {
+			return best;
+		}
+		bin_count = std::clamp(bin_count, 2, max_bins);
+		int chunks = chunk_count(count, parallel);
+
+		//bins are placed over the centroid bounds, not the primitive bounds
+		std::vector<aabb> partial_bounds(chunks);
+		parallel_for(chunks, [&](int c) {
+			size_t first = start + count * c / chunks;
+			size_t last = start + count * (c + 1) / chunks;
+			for (size_t i = first; i < last; i++) {
+				partial_bounds[c] = aabb(partial_bounds[c], aabb(prims[i].centroid, prims[i].centroid));
+			}
+		});
+		aabb centroid_bounds;
+		for (const aabb& b : partial_bounds) {
+			centroid_bounds = aabb(centroid_bounds, b);
+		}
+
+		double parent_area = bounds.surface_area();
+		double inv_parent_area = (parent_area > 0.0) ? 1.0 / parent_area : 1.0;
+		int best_bin = -1;
+
+		//all centroids on one plane means nothing to split on that axis
+		bool splittable[3];
+		double scale[3];
+		for (int axis = 0; axis < 3; axis++) {
+			const interval& extent = centroid_bounds.axis(axis);
+			splittable[axis] = extent.size() > 1e-12;
+			scale[axis] = splittable[axis] ? bin_count / extent.size() : 0.0;
+		}
+
+		//one pass fills the bins of all 3 axes, every chunk has its own set (merged in order below)
+		bin_set local_set;
+		std::vector<bin_set> chunk_sets((chunks > 1) ? chunks : 0);
+		bin_set* sets = (chunks > 1) ? chunk_sets.data() : &local_set;
+		parallel_for(chunks, [&](int c) {
+			size_t first = start + count * c / chunks;
+			size_t last = start + count * (c + 1) / chunks;
+			for (size_t i = first; i < last; i++) {
+				for (int axis = 0; axis < 3; axis++) {
+					if (!splittable[axis]) {
+						continue;
+					}
+					int b = std::min(bin_count - 1, static_cast<int>((prims[i].centroid[axis] - centroid_bounds.axis(axis).min) * scale[axis]));
+					sets[c].bins[axis][b].count++;
+					sets[c].bins[axis][b].box = aabb(sets[c].bins[axis][b].box, prims[i].box);
+				}
+			}
+		});
+		for (int c = 1; c < chunks; c++) {
+			for (int axis = 0; axis < 3; axis++) {
+				for (int b = 0; b < bin_count; b++) {
+					sets[0].bins[axis][b].count += sets[c].bins[axis][b].count;
+					sets[0].bins[axis][b].box = aabb(sets[0].bins[axis][b].box, sets[c].bins[axis][b].box);
+				}
+			}
+		}
+
+		for (int axis = 0; axis < 3; axis++) {
+			if (!splittable[axis]) {
+				continue;
+			}
+			const bin* bins = sets[0].bins[axis];
+
+			//sweep from the right to get area and count of every right-hand side
+			double right_area[max_bins];
+			size_t right_count[max_bins];
+			aabb right_box;
+			size_t right_n = 0;
+			for (int b = bin_count - 1; b > 0; b--) {
+				right_box = aabb(right_box, bins[b].box);
+				right_n += bins[b].count;
+				right_area[b - 1] = right_box.surface_area();
+				right_count[b - 1] = right_n;
+			}
+
+			//sweep from the left and evaluate every plane between bins
+			aabb left_box;
+			size_t left_n = 0;
+			for (int b = 0; b < bin_count - 1; b++) {
+				left_box = aabb(left_box, bins[b].box);
+				left_n += bins[b].count;
+				if (left_n == 0 || right_count[b] == 0) {
+					continue;
+				}
+				double cost = traversal_cost + intersection_cost * inv_parent_area *
+					(left_n * left_box.surface_area() + right_count[b] * right_area[b]);
+				if (cost < best.cost) {
+					best.cost = cost;
+					best.axis = axis;
+					best_bin = b;
+				}
+			}
+		}
+
+		double leaf_cost = intersection_cost * count;
+		if (count <= static_cast<size_t>(std::max(1, max_leaf_size)) && leaf_cost <= best.cost) {
+			best.axis = -1;
+			best.cost = leaf_cost;
+			return best;
+		}
+
+		if (best_bin < 0) {
+			//all centroids coincide but the node is too big for a leaf, split by position in the list
+			best.axis = bounds.longest_axis();
+			best.mid = start + count / 2;
+			best.cost = leaf_cost;
+			return best;
+		}
+
+		int axis = best.axis;
+		double axis_min = centroid_bounds.axis(axis).min;
+		auto it = std::partition(prims.begin() + start, prims.begin() + end, [&](const bvh_primitive& p) {
+			int b = std::min(bin_count - 1, static_cast<int>((p.centroid[axis] - axis_min) * scale[axis]));
+			return b <= best_bin;
+		});
+		best.mid = static_cast<size_t>(it - prims.begin());
+		return best;
+	}
+}
+
+//wireframe visualization shared by all BVH layouts (BVH debug mode)
+namespace bvh_debug {
+	//nodes drawn for the selected level (-1 = leaves only)
+	inline bool is_debug_level(bool is_leaf, int depth) {
+		return (global_settings::debug_bvh_level == -1) ? is_leaf : (depth == global_settings::debug_bvh_level);
+	}
+
+	//check the edges on entry point(min) and exit point(max), returns distance to the frame
+	inline bool hit_frame(const aabb& box, const ray& r, const interval& box_t, double& frame_t) {
+		point3 p_entry = r.at(box_t.min + 0.0001f);
+		point3 p_exit = r.at(box_t.max - 0.0001f);
+
+		//increased thickness for better visibility
+		float perspective_thickness = global_settings::bvh_thickness * (0.05f + box_t.min * 0.1f);
+
+		if (box.is_on_edge(p_entry, perspective_thickness)) {
+			frame_t = box_t.min;
+			return true;
+		}
+		if (box.is_on_edge(p_exit, perspective_thickness)) {
+			frame_t = box_t.max;
+			return true;
+		}
+		return false;
+	}
+
+	inline color level_color(int depth) {
+		float g = std::min(depth * 0.15f, 1.0f);
+		return color(0.4f, g, (1.0f - g));
+	}
+
+	//bright frame on the box edges
+	inline void set_frame_hit(hit_record& rec, const ray& r, double frame_t, int depth) {
+		rec.t = frame_t;
+		rec.p = r.at(rec.t);
+		rec.normal = vec3(0, 0, 1);
+		rec.mat = make_shared<diffuse_light>(level_color(depth) * 4.0f);
+	}
+
+	//dim glow for geometry inside the box
+	inline void set_volume_hit(hit_record& rec, int depth) {
+		rec.mat = make_shared<diffuse_light>(level_color(depth) * 0.1f);
+	}
+}
+
+//float bounds of the flattened layouts are rounded outwards so they always contain the double box
+namespace bvh_float {
+	inline float round_down(double v) {
+		float f = static_cast<float>(v);
+		return (static_cast<double>(f) > v) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	inline float round_up(double v) {
+		float f = static_cast<float>(v);
+		return (static_cast<double>(f) < v) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+	}
+}
+
+//flattened BVH used for rendering (layouts: linear_bvh.hpp, wide_bvh.hpp)
+class flat_bvh : public hittable {
+public:
+	//recomputes all node bounds bottom-up after primitives moved, the tree topology is kept
+	virtual void refit() = 0;
+	virtual size_t node_count() const = 0;
+
+	//source index of every primitive slot (leaves reference contiguous slot ranges)
+	const std::vector<uint32_t>& primitive_order() const {
+		return leaf_order;
+	}
+
+protected:
+	std::vector<uint32_t> leaf_order;
+};
+
+template <int N> class wide_bvh;
 
 class bvh_node : public hittable {
 public:
@@ -12,35 +286,38 @@ public:
 		: bvh_node(list.objects, 0, list.objects.size()) {
 	}
 
-	bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
-		//randomly choose axis (0,1 or 2) to split on
-		int axis = random_int(0, 2);
+	bvh_node(const std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+		int bin_count = global_settings::bvh_sah_bins,
+		int max_leaf_size = global_settings::bvh_max_leaf_size) {
+		auto build_start = std::chrono::steady_clock::now();
 
-		auto comparator = (axis == 0) ? box_x_compare
-			: (axis == 1) ? box_y_compare
-			: box_z_compare;
+		//gather bounds once, the recursive build only moves these small records around
+		std::vector<bvh_primitive> prims(end - start);
+		int count = static_cast<int>(end - start);
+		parallel_for(count, [&](int i) {
+			aabb box = objects[start + i]->bounding_box();
+			prims[i] = { box, box.centroid(), start + i };
+		}, prims.size() >= bvh_sah::parallel_threshold);
+		build_parallel(objects, prims, bin_count, max_leaf_size);
 
-		size_t object_span = end - start;
+		build_time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+	}
 
-		if (object_span == 1) {
-			left = right = objects[start];
-		} else if (object_span == 2) {
-			if (comparator(objects[start], objects[start + 1])) {
-				left = objects[start];
-				right = objects[start + 1];
-			} else {
-				left = objects[start + 1];
-				right = objects[start];
-			}
-		} else {
-			//sort objects and split in half
-			std::sort(objects.begin() + start, objects.begin() + end, comparator);
+	//index-only tree over primitive bounds (e.g. the triangles of a mesh), leaves keep indices into boxes
+	//and no objects, so it is only meant to be flattened (hit() on it finds nothing)
+	bvh_node(const std::vector<aabb>& boxes,
+		int bin_count = global_settings::bvh_sah_bins,
+		int max_leaf_size = global_settings::bvh_max_leaf_size) {
+		auto build_start = std::chrono::steady_clock::now();
 
-			auto mid = start + object_span / 2;
-			left = make_shared<bvh_node>(objects, start, mid);
-			right = make_shared<bvh_node>(objects, mid, end);
-		}
-		bbox = aabb(left->bounding_box(), right->bounding_box());
+		std::vector<bvh_primitive> prims(boxes.size());
+		int count = static_cast<int>(boxes.size());
+		parallel_for(count, [&](int i) {
+			prims[i] = { boxes[i], boxes[i].centroid(), static_cast<size_t>(i) };
+		}, prims.size() >= bvh_sah::parallel_threshold);
+		build_parallel({}, prims, bin_count, max_leaf_size);
+
+		build_time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
 	}
 
 	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
@@ -54,96 +331,170 @@ public:
 		}
 
 		if (debug_wire) {
-			//check the edges on entry point(min) and exit point(max) 
-			//entry point calculated basing on bbox_t.min
-			point3 p_entry = r.at(bbox_t.min + 0.0001f);
-			//exit point calculated basing on bbox_t.max
-			point3 p_exit = r.at(bbox_t.max - 0.0001f);
-
-			bool is_leaf = (std::dynamic_pointer_cast<bvh_node>(left) == nullptr);
-
-			//increased thickness for better visibility
-			float perspective_thickness = global_settings::bvh_thickness * (0.05f + bbox_t.min * 0.1f);
-			bool is_current_debug_level = (global_settings::debug_bvh_level == -1) 
-											? is_leaf 
-											: (depth == global_settings::debug_bvh_level);
+			bool is_leaf = (left == nullptr);
+			bool is_current_debug_level = bvh_debug::is_debug_level(is_leaf, depth);
 
 			//draw the frames
-			if (is_current_debug_level) {
-				if (bbox.is_on_edge(p_entry, perspective_thickness) ||
-					bbox.is_on_edge(p_exit, perspective_thickness)) {
-					rec.t = (bbox.is_on_edge(p_entry, perspective_thickness)) ? bbox_t.min : bbox_t.max;
-					rec.p = r.at(rec.t);
-					rec.normal = vec3(0, 0, 1);
-
-					float g = std::min(depth * 0.15f, 1.0f);
-					float brightness = 4.0f;
-
-					color base_color = color(0.4f, g, (1.0f - g));
-					color debug_color = base_color * brightness;
-					rec.mat = make_shared<diffuse_light>(debug_color);
-					return true;
-				}
+			double frame_t;
+			if (is_current_debug_level && bvh_debug::hit_frame(bbox, r, bbox_t, frame_t)) {
+				bvh_debug::set_frame_hit(rec, r, frame_t, depth);
+				return true;
 			}
 
-			bool hit_left = left->hit(r, ray_t, rec, depth + 1, debug_wire);
-			if (hit_left) { 
-				ray_t.max = rec.t; 
-			}
-			bool hit_right = right->hit(r, ray_t, rec, depth + 1, debug_wire);
-
-			bool hit_anything =  hit_left || hit_right;
+			bool hit_anything = is_leaf
+				? hit_primitives(r, ray_t, rec, depth, debug_wire)
+				: hit_children(r, ray_t, rec, depth, debug_wire);
 
 			//volumes
 			if (hit_anything && is_current_debug_level) {
-				float g = std::min(depth * 0.15f, 1.0f);
-				color volume_color = color(0.4f, g, (1.0f - g)) * 0.1f;
-				rec.mat = make_shared<diffuse_light>(volume_color);
-			}
-
-			//standard path without debugging
-			if (left == nullptr || right == nullptr) { 
-				return false; 
+				bvh_debug::set_volume_hit(rec, depth);
 			}
 
 			return hit_anything;
 		}
 
 		//standard path without debbuging
-		bool hit_left = left->hit(r, ray_t, rec, depth + 1, false);
-		if (hit_left) { 
-			ray_t.max = rec.t; 
+		if (left == nullptr) {
+			return hit_primitives(r, ray_t, rec, depth, false);
 		}
-		bool hit_right = right->hit(r, ray_t, rec, depth + 1, false);
-		return hit_left || hit_right;
+		return hit_children(r, ray_t, rec, depth, false);
 	}
 
 	aabb bounding_box() const override {
 		return bbox;
 	}
 
+	//walk the tree and sum up the SAH cost (relative to the root box area) and shape metrics
+	bvh_stats stats() const {
+		bvh_stats s;
+		double root_area = bbox.surface_area();
+		accumulate_stats(s, (root_area > 0.0) ? 1.0 / root_area : 0.0, 0);
+		s.build_time_ms = build_time_ms;
+		return s;
+	}
+
 private:
-	shared_ptr<hittable> left;
-	shared_ptr<hittable> right;
+	friend class linear_bvh; //flattens the tree
+	template <int N> friend class wide_bvh; //collapses the tree into N-wide nodes
+
+	//interior nodes own two children, leaves own up to max_leaf_size primitives
+	shared_ptr<bvh_node> left;
+	shared_ptr<bvh_node> right;
+	std::vector<shared_ptr<hittable>> primitives; //empty in index-only trees
+	std::vector<uint32_t> indices; //leaves: positions of the primitives in the source list
 	aabb bbox;
+	int axis = 0; //split axis of interior nodes
+	double build_time_ms = 0.0; //root only
+
+	bvh_node() = default;
+
+	//bounds and split of one node: turns it into a leaf or allocates its two (still empty) children
+	bvh_sah::split init_node(const std::vector<shared_ptr<hittable>>& objects, std::vector<bvh_primitive>& prims,
+		size_t start, size_t end, int bin_count, int max_leaf_size, bool parallel) {
+
+		for (size_t i = start; i < end; i++) {
+			bbox = aabb(bbox, prims[i].box);
+		}
 
-	//comparison functions for sorting
-	static bool box_compare(
-		const shared_ptr<hittable> a, 
-		const shared_ptr<hittable> b,
-		int axis_index) {
-		
-		const auto a_axis_range = a->bounding_box().axis(axis_index);
-		const auto b_axis_range = b->bounding_box().axis(axis_index);
-		return a_axis_range.min < b_axis_range.min;
+		auto split = bvh_sah::find_and_partition(prims, start, end, bbox, bin_count, max_leaf_size, parallel);
+
+		if (split.axis < 0) {
+			indices.reserve(end - start);
+			for (size_t i = start; i < end; i++) {
+				indices.push_back(static_cast<uint32_t>(prims[i].index));
+				if (!objects.empty()) {
+					primitives.push_back(objects[prims[i].index]);
+				}
+			}
+			return split;
+		}
+
+		axis = split.axis;
+		left = shared_ptr<bvh_node>(new bvh_node());
+		right = shared_ptr<bvh_node>(new bvh_node());
+		return split;
+	}
+
+	void build(const std::vector<shared_ptr<hittable>>& objects, std::vector<bvh_primitive>& prims,
+		size_t start, size_t end, int bin_count, int max_leaf_size) {
+
+		auto split = init_node(objects, prims, start, end, bin_count, max_leaf_size, false);
+		if (split.axis < 0) {
+			return;
+		}
+		left->build(objects, prims, start, split.mid, bin_count, max_leaf_size);
+		right->build(objects, prims, split.mid, end, bin_count, max_leaf_size);
+	}
+
+	//top levels are split with parallel binning until the subtrees are small enough,
+	//then the subtrees (disjoint ranges of prims) are built concurrently, largest first
+	void build_parallel(const std::vector<shared_ptr<hittable>>& objects, std::vector<bvh_primitive>& prims,
+		int bin_count, int max_leaf_size) {
+
+		struct subtree {
+			bvh_node* node;
+			size_t start;
+			size_t end;
+		};
+		std::vector<subtree> large = { { this, 0, prims.size() } };
+		std::vector<subtree> small;
+
+		while (!large.empty()) {
+			subtree t = large.back();
+			large.pop_back();
+			if (t.end - t.start < bvh_sah::parallel_threshold) {
+				small.push_back(t);
+				continue;
+			}
+			auto split = t.node->init_node(objects, prims, t.start, t.end, bin_count, max_leaf_size, true);
+			if (split.axis >= 0) {
+				large.push_back({ t.node->left.get(), t.start, split.mid });
+				large.push_back({ t.node->right.get(), split.mid, t.end });
+			}
+		}
+
+		std::sort(small.begin(), small.end(), [](const subtree& a, const subtree& b) {
+			return (a.end - a.start) > (b.end - b.start);
+		});
+		int small_count = static_cast<int>(small.size());
+		parallel_for(small_count, [&](int i) {
+			small[i].node->build(objects, prims, small[i].start, small[i].end, bin_count, max_leaf_size);
+		}, small_count > 1 && prims.size() >= bvh_sah::parallel_threshold, 1);
 	}
-	static bool box_x_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-		return box_compare(a, b, 0);
+
+	bool hit_children(const ray& r, interval ray_t, hit_record& rec, int depth, bool debug_wire) const {
+		bool hit_left = left->hit(r, ray_t, rec, depth + 1, debug_wire);
+		if (hit_left) { 
+			ray_t.max = rec.t; 
+		}
+		bool hit_right = right->hit(r, ray_t, rec, depth + 1, debug_wire);
+		return hit_left || hit_right;
 	}
-	static bool box_y_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-		return box_compare(a, b, 1);
+
+	bool hit_primitives(const ray& r, interval ray_t, hit_record& rec, int depth, bool debug_wire) const {
+		bool hit_anything = false;
+		for (const auto& object : primitives) {
+			if (object->hit(r, ray_t, rec, depth + 1, debug_wire)) {
+				hit_anything = true;
+				ray_t.max = rec.t;
+			}
+		}
+		return hit_anything;
 	}
-	static bool box_z_compare(const shared_ptr<hittable> a, const shared_ptr<hittable> b) {
-		return box_compare(a, b, 2);
+
+	void accumulate_stats(bvh_stats& s, double inv_root_area, int depth) const {
+		double relative_area = bbox.surface_area() * inv_root_area;
+		s.node_count++;
+		s.max_depth = std::max(s.max_depth, depth);
+
+		if (left == nullptr) {
+			s.leaf_count++;
+			s.primitive_count += indices.size();
+			s.sah_cost += relative_area * bvh_sah::intersection_cost * indices.size();
+			return;
+		}
+		s.sah_cost += relative_area * bvh_sah::traversal_cost;
+		left->accumulate_stats(s, inv_root_area, depth + 1);
+		right->accumulate_stats(s, inv_root_area, depth + 1);
 	}
 };
\ No newline at end of file
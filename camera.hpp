@@ -7,12 +7,18 @@
 #include "environment.hpp"
 #include "color_processing.hpp"
 #include "bloom.hpp"
+#include "tile_scheduler.hpp"
+#include "thread_pool.hpp"
+#include "sampler.hpp"
+#include "lights.hpp"
+#include "wavefront.hpp"
 #include <OpenImageDenoise/oidn.hpp>
 
 #include <iostream>
 #include <limits>
 #include <algorithm>
 #include <thread>
+#include <chrono>
 #include <functional>
 #include <iomanip>
 #include <vector>
@@ -20,6 +26,16 @@
 
 namespace fs = std::filesystem;
 
+//outcome of a render (achieved samples and where the time went)
+struct render_result {
+	int samples_per_pixel = 0; //passes finished over the whole frame
+	double average_samples_per_pixel = 0.0; //samples traced per pixel (lower with adaptive sampling)
+	double render_ms = 0.0; //sampling passes
+	double finalize_ms = 0.0; //auto-exposure, denoising and post-processing
+	bool cancelled = false;
+	bool deadline_met = true; //always true without a deadline
+};
+
 class camera {
 public:
 	//image settings
@@ -27,8 +43,9 @@ public:
 	int image_width = 400;      //rendered image width in pixel count
 	int image_height = 225; //rendered image height
 	int samples_per_pixel = 30; //count of random smaples for each pixel
-	int current_samples_count = 0; // Licznik aktualnie obliczonych próbek
+	std::atomic<int> current_samples_count{ 0 }; //samples per pixel finished so far (whole-frame passes)
 	int max_depth = 10;         //max recursion depth
+	uint64_t frame_index = 0; //mixed into the per-sample random seeds, renders of the same frame are bit-identical
 	double sky_intesity = 1.0;    //intensity multiplier for sky color default 1.0
 
 	//camera settings
@@ -41,6 +58,39 @@ public:
 	double defocus_angle = 0.5; //variation angle of rays through each pixel
 	double focus_dist = 10; //distance from camera lookfrom point to plane of perfect focus
 
+	//sample sequence for pixel jitter, lens and BSDF sampling (see sampler.hpp)
+	sampler_type sampler = sampler_type::SOBOL;
+
+	//camera rays of a pixel tile traced through the BVH together (4, 8 or 16), 1 = one ray at a time
+	int ray_packet_size = 8;
+
+	//progressive rendering: the whole frame gets 1 spp per pass and the buffers hold the running mean,
+	//so the preview refines everywhere at once (off = every pixel gets all its samples in one pass)
+	bool progressive = true;
+	double time_limit_seconds = 0.0; //no new pass is started after this (0 = until samples_per_pixel)
+
+	//adaptive sampling: pixel blocks whose noise estimate falls below the threshold stop receiving samples,
+	//the following passes only trace the noisy regions (samples_per_pixel is the maximum)
+	bool adaptive_sampling = false;
+	int adaptive_min_samples = 16; //samples every pixel gets before its error is checked
+	float adaptive_threshold = 0.05f; //relative standard error of the mean pixel luminance
+
+	//deadline renders (render_with_deadline): time kept free for denoising and post-processing at the end,
+	//the larger of this and the last measured finalize time is reserved
+	double finalize_reserve_seconds = 0.25;
+
+	//next-event estimation: diffuse surfaces and fog sample a light (emissive objects, sun) with a shadow ray at every
+	//bounce, combined with the scattered rays by multiple importance sampling (see lights.hpp)
+	bool light_sampling = true;
+	scene_lights lights; //emissive objects of the scene, set with lights.build(world) when the geometry changes
+
+	//wavefront integrator: the paths of several tiles advance one bounce at a time in batched stages
+	//(intersection, misses, material sort, shading; see wavefront.hpp), off = each path runs through all its bounces
+	bool wavefront = false;
+
+	//edge of the square tiles handed out to the render threads (16 or 32), 0 = one fixed block of rows per thread
+	int render_tile_size = 16;
+
 	//denoiser flag
 	bool use_denoiser = false;
 
@@ -70,7 +120,8 @@ public:
 		"Normals",
 		"Reflections",
 		"Refractions", 
-		"Z-Depth"
+		"Z-Depth",
+		"Sample Heatmap"
 	};
 
 	//current render pass for GUI display
@@ -83,9 +134,37 @@ public:
 	std::vector<color> z_depth_buffer;
 	std::vector<color> reflection_buffer;
 	std::vector<color> refraction_buffer;
+	std::vector<color> sample_heatmap_buffer; //samples per pixel of the last render as a blue-to-red ramp
+
+	//per-pixel state of adaptive sampling (samples traced and running mean of the squared luminance)
+	std::vector<int> sample_count;
+	std::vector<float> luminance_sq;
 
 	std::vector<color> final_framebuffer; //image after post-processing (filters applied)
-	std::atomic<int> lines_rendered{ 0 }; //atomic counter for rendered lines
+	std::atomic<long long> samples_rendered{ 0 }; //atomic counter for rendered pixel samples (progress bar)
+	std::atomic<long long> samples_skipped{ 0 }; //pixel samples left out because their pixel converged
+
+	//first-hit throughput of the last render, per thread (shown in the Engine Info panel)
+	double primary_rays_per_second = 0.0;
+	int primary_packet_size = 1;
+
+	//load balance of the last render: wall time, per-thread idle time (waiting for the slowest thread) and tile count
+	double render_wall_ms = 0.0;
+	std::vector<double> thread_idle_ms;
+	int render_tile_count = 0;
+	double average_samples_per_pixel = 0.0; //samples traced per pixel in the last render
+
+	//fraction of the pixel samples of the current render that are done
+	float progress() const {
+		if (deadline_mode) {
+			double budget = std::chrono::duration<double>(render_deadline - render_begin).count();
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - render_begin).count();
+			return (budget > 0.0) ? static_cast<float>(std::clamp(elapsed / budget, 0.0, 1.0)) : 0.0f;
+		}
+		double total = static_cast<double>(image_width) * image_height * samples_per_pixel;
+		double done = static_cast<double>(samples_rendered.load() + samples_skipped.load());
+		return (total > 0.0) ? static_cast<float>(std::min(1.0, done / total)) : 0.0f;
+	}
 
 	//choose the buffer function
 	const std::vector<color>& get_active_buffer() {
@@ -108,6 +187,9 @@ public:
 			case render_pass::Z_DEPTH: {
 				return z_depth_buffer;
 			}
+			case render_pass::SAMPLE_HEATMAP: {
+				return sample_heatmap_buffer;
+			}
 			default:
 				return render_accumulator;
 		}
@@ -160,10 +242,10 @@ public:
 			double ev_multiplier = std::pow(2.0, post.exposure);
 
 			//optimalization multiplying by exposure 
-			#pragma omp parallel for
-			for (int i = 0; i < (int)final_framebuffer.size(); ++i) {
+			//(previews run while a render occupies the pool, then the loops stay on this thread)
+			global_thread_pool().parallel_for_if_idle((int)final_framebuffer.size(), [&](int i) {
 				final_framebuffer[i] *= ev_multiplier;
-			}
+			});
 
 			//bloom
 			if (post.use_bloom) {
@@ -180,8 +262,7 @@ public:
 		}
 
 		//final process (per pixel)
-		#pragma omp parallel for schedule(static)
-		for (int idx = 0; idx < (int)final_framebuffer.size(); ++idx) {
+		global_thread_pool().parallel_for_if_idle((int)final_framebuffer.size(), [&](int idx) {
 			color c = final_framebuffer[idx];
 			float u = (float)(idx % w) / (w - 1);
 			float v = (float)(idx / w) / (h - 1);
@@ -198,12 +279,12 @@ public:
 			} else {
 				//(albedo, normals, z-depth)
 				//clamp and gamma
-				c = color(std::clamp(c.x(), 0.0, 1.0),
-					std::clamp(c.y(), 0.0, 1.0),
-					std::clamp(c.z(), 0.0, 1.0));
+				c = color(std::clamp<double>(c.x(), 0.0, 1.0),
+					std::clamp<double>(c.y(), 0.0, 1.0),
+					std::clamp<double>(c.z(), 0.0, 1.0));
 				final_framebuffer[idx] = linear_to_gamma(c);
 			}
-		}
+		});
 	}
 
 	void reset_accumulator() {
@@ -225,20 +306,50 @@ public:
 		prepare_buffer(z_depth_buffer);
 		prepare_buffer(reflection_buffer);
 		prepare_buffer(refraction_buffer);
+		prepare_buffer(sample_heatmap_buffer);
 
 		// 2. Zerujemy licznik próbkowania (aby zacząć od 1. próbki)
 		current_samples_count = 0;
-		// 3. Opcjonalnie zerujemy postęp linii
-		lines_rendered = 0;
+		// 3. Opcjonalnie zerujemy postęp
+		samples_rendered = 0;
+		samples_skipped = 0;
+	}
+
+	//render with a wall-clock budget instead of samples_per_pixel: progressive passes are added until
+	//the budget minus the finalize reserve is used up, then the image is finalized before the deadline
+	render_result render_with_deadline(const hittable& world, const EnvironmentSettings& env, const post_processor& post,
+		std::atomic<bool>& render_flag, double budget_seconds) {
+
+		render_begin = std::chrono::steady_clock::now();
+		render_deadline = render_begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(std::max(0.0, budget_seconds)));
+
+		double reserve = std::max(finalize_reserve_seconds, last_finalize_ms * 1e-3);
+		passes_end = render_deadline - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(std::min(reserve, budget_seconds)));
+
+		deadline_mode = true;
+		render_result result = render(world, env, post, render_flag);
+		deadline_mode = false;
+
+		result.deadline_met = (std::chrono::steady_clock::now() <= render_deadline);
+		std::cerr << "Deadline render: " << result.samples_per_pixel << " spp in " << result.render_ms + result.finalize_ms
+			<< " ms (budget " << budget_seconds * 1e3 << " ms, " << (result.deadline_met ? "met" : "missed") << ")\n";
+		return result;
 	}
 
 	//render
-	void render(const hittable& world, const EnvironmentSettings& env, const post_processor& post, std::atomic<bool>& render_flag) {
+	render_result render(const hittable& world, const EnvironmentSettings& env, const post_processor& post, std::atomic<bool>& render_flag) {
+		render_result result;
+
 		// - 1. INITIALIZE - 
 		initialize();
+		sky = physical_sky(env);
+		hdr_background = hdr_environment(env);
+		lights.set_environment(env);
+		sample_lights = light_sampling && !lights.empty() && !global_settings::bvh_debug_mode;
 
-		int num_threads = std::thread::hardware_concurrency();
-		std::cerr << "Render threading started with " << num_threads << " threads.\n";
+		std::cerr << "Render threading started with " << global_thread_pool().size() << " threads.\n";
 
 		// - 2. MULTITHREADING  -
 		//transfer reference to is_rendering so threads can check if they should stop working
@@ -248,12 +359,18 @@ public:
 			render_flag);
 
 
+		result.samples_per_pixel = current_samples_count;
+		result.average_samples_per_pixel = average_samples_per_pixel;
+		result.render_ms = render_wall_ms;
+
 		//if rendering was cancelled, skip post-processing steps 
 		if (!render_flag.load()) {
-			return;
+			result.cancelled = true;
+			return result;
 		}
 
-		std::cerr << "Render completed. Total samples: " << samples_per_pixel << "\n";
+		std::cerr << "Render completed. Total samples: " << current_samples_count << "\n";
+		auto finalize_start = std::chrono::steady_clock::now();
 
 		// - 3. AUTO-EXPOSURE -
 		if (post.use_auto_exposure) {
@@ -293,6 +410,10 @@ public:
 		// - 5. COMPOSE FINAL FRAMEBUFFER WITH POST-PROCESSING -
 		std::cerr << "Render finished. Finalizing buffers...\n";
 		update_post_processing(post, image_width, image_height);
+
+		last_finalize_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - finalize_start).count();
+		result.finalize_ms = last_finalize_ms;
+		return result;
 	}
 
 	//save passes to .png
@@ -337,6 +458,10 @@ public:
 			process_framebuffer_to_image(z_depth_buffer, full_path, pp, true, true);
 			break;
 		}
+		case render_pass::SAMPLE_HEATMAP: {
+			process_framebuffer_to_image(sample_heatmap_buffer, full_path, pp, true, true);
+			break;
+		}
 		default:
 			break;
 		}
@@ -352,6 +477,35 @@ private:
 	vec3 defocus_disk_u; //defocus disk horizntal radius
 	vec3 defocus_disk_v; //defocus disk vertical radius
 
+	constexpr static int max_packet_size = 16; //largest ray packet (ray_packet::max_size)
+	constexpr static int wavefront_batch_paths = 4096; //paths a render thread collects before the wavefront stages run
+	constexpr static uint32_t camera_dimensions = 4; //sampler dimensions of get_ray (pixel jitter, lens), shading starts after them
+
+	//per-pixel sums of one tile while its samples are traced
+	struct pixel_sums {
+		color beauty = color(0.0, 0.0, 0.0);
+		color albedo = color(0.0, 0.0, 0.0);
+		color normal = color(0.0, 0.0, 0.0);
+		color reflection = color(0.0, 0.0, 0.0);
+		color refraction = color(0.0, 0.0, 0.0);
+		color zdepth = color(0.0, 0.0, 0.0);
+		double luminance_sq = 0.0; //sum of the squared beauty luminance (variance estimate)
+	};
+
+	//deadline render state (render_with_deadline), no pass is started or continued after passes_end
+	bool deadline_mode = false;
+	std::chrono::steady_clock::time_point render_begin;
+	std::chrono::steady_clock::time_point render_deadline;
+	std::chrono::steady_clock::time_point passes_end;
+	double last_finalize_ms = 0.0; //measured finalize time of the last render, used for the next reserve
+	constexpr static int deadline_max_samples = 1 << 16; //samples per pixel cap of a deadline render
+
+	bool sample_lights = false; //next-event estimation in the current render
+	physical_sky sky; //physical sun mode background of the current render
+	hdr_environment hdr_background; //HDR mode background of the current render
+
+	constexpr static double adaptive_dark_floor = 0.05; //luminance below which the error is measured absolutely
+
 	constexpr static double tmin = 0.001; //min distance (avoid selfcovering)
 	constexpr static double tmax = std::numeric_limits<double>::infinity(); //max distance
 
@@ -413,168 +567,449 @@ private:
 		double z_depth_max_dist,
 		std::atomic<bool>& render_flag) {
 
-		//reset atomic counter for progress bar
-		this->lines_rendered = 0;
+		//reset atomic counters for progress bar
+		this->samples_rendered = 0;
+		this->samples_skipped = 0;
+		this->current_samples_count = 0;
+
+		//adaptive sampling state, a pixel block is skipped by the following passes once it converged
+		size_t pixel_count = static_cast<size_t>(image_width) * image_height;
+		sample_count.assign(pixel_count, 0);
+		luminance_sq.assign(pixel_count, 0.0f);
+		std::vector<unsigned char> converged(pixel_count, 0);
+		std::atomic<int> active_blocks = 0;
+		std::atomic<bool> pass_cut_off = false; //a thread stopped the current pass at the deadline
 
 		//reset main framebuffer 
 		std::fill(framebuffer.begin(), framebuffer.end(), color(0.0, 0.0, 0.0));
 
-		//local atomic counter for progress bar in this function
-		std::atomic<int> lines_done = 0;
+		//render threads = threads of the shared pool (workers + this thread)
+		int num_threads = global_thread_pool().size();
+
+		//camera-ray timing for the Engine Info panel (summed over the threads)
+		std::atomic<long long> primary_ns_total = 0;
+		std::atomic<long long> primary_rays_total = 0;
+
+		//pixel tile whose camera rays (one per pixel and sample) are traced together
+		int packet = (ray_packet_size >= 16) ? 16 : (ray_packet_size >= 8) ? 8 : (ray_packet_size >= 4) ? 4 : 1;
+		int tile_w = (packet == 4) ? 2 : 4;
+		int tile_h = (packet == 16) ? 4 : 2; //single rays use the 4x2 tile as well, so the timings compare
+
+		//the BVH debug view shades in ray_color only, it always uses the megakernel
+		const bool use_wavefront = wavefront && !global_settings::bvh_debug_mode;
+
+		//a deadline render keeps adding passes until the time runs out, samples_per_pixel doesn't apply
+		const int max_samples = deadline_mode ? deadline_max_samples : samples_per_pixel;
+		const int aux_sample = std::clamp(max_samples / 8, 64, 1024); //for albedo, normals, zdepth
+
+		//samples of the current pass: pixels already hold the mean of first_sample samples
+		int first_sample = 0;
+		int pass_samples = 0;
+		tile_scheduler* scheduler = nullptr;
+		std::vector<double> finish_ms(num_threads, 0.0); //end of a thread's work, relative to the pass start
+		auto pass_start = std::chrono::steady_clock::now();
+
+		//lamba function for a render thread, renders tiles of the current pass until the scheduler runs out of them
+		auto render_tiles = [&](int thread_index) {
+			long long primary_ns = 0;
+			long long primary_rays = 0;
+			int block_count = 0; //pixel blocks traced by this thread in this pass
+
+			//running means: n samples after this pass (beauty and light passes), aux passes stop at aux_sample
+			const int n_before = first_sample;
+			const int n_after = first_sample + pass_samples;
+			const int aux_before = std::min(n_before, aux_sample);
+			const int aux_after = std::min(n_after, aux_sample);
+
+			//mean of the previous samples updated with the sum of this pass
+			auto blend = [](color& mean, const color& pass_sum, int before, int after) {
+				if (after == before) {
+					return;
+				}
+				mean = (before == 0) ? pass_sum / after : (mean * before + pass_sum) / after;
+			};
+
+			//block of pixels below the error threshold: standard error of the mean luminance relative to the mean
+			//(dark pixels are measured against adaptive_dark_floor, so their noise doesn't count as large)
+			auto block_converged = [&](int x0, int y0, int cols, int rows) {
+				if (n_before < std::max(adaptive_min_samples, 2)) {
+					return false;
+				}
+				for (int k = 0; k < rows * cols; k++) {
+					int idx = pixel_index(x0, y0, cols, k);
+					double mean = framebuffer[idx].luminance();
+					double variance = std::max(0.0, luminance_sq[idx] - mean * mean) * n_before / (n_before - 1);
+					double error = std::sqrt(variance / n_before) / std::max(mean, adaptive_dark_floor);
+					if (error > adaptive_threshold) {
+						return false;
+					}
+				}
+				return true;
+			};
 
-		//number of threads = number of cores
-		int num_threads = std::max(1u, std::thread::hardware_concurrency());
-		std::vector<std::thread> threads;
+			//albedo, normals and z-depth of the first hit
+			auto first_hit_passes = [&](pixel_sums& px, const hit_record& rec, int s) {
+				if (s >= aux_sample) {
+					return;
+				}
+				// - albedo 
+				if (use_albedo_buffer) {
+					px.albedo += rec.mat->get_albedo(rec);
+				}
+				// - normals
+				if (use_normal_buffer) {
+					vec3 n = unit_vector(rec.normal);
+					//transition on camera space(view space)
+					double nx = dot(n, u);
+					double ny = dot(n, v);
+					double nz = dot(n, w);
+					//mapping to range[0,1]
+					px.normal += color(
+						(nx + 1.0) * 0.5,
+						(ny + 1.0) * 0.5,
+						(nz + 1.0) * 0.5
+					);
+				}
+				// - Z-Depth
+				if (use_z_depth_buffer) {
+					double z_depth = 1.0 - std::clamp(rec.t / z_depth_max_dist, 0.0, 1.0);
+					px.zdepth += color(z_depth, z_depth, z_depth);
+				}
+			};
 
-		//lamba function for rendering a block of rows
-		auto render_rows = [&](int start_y, int end_y) {
-			int local_lines_done = 0; //local thread counter
+			//reflection and refraction
+			//use 'rec' from the first hit
+			auto light_passes = [&](pixel_sums& px, const ray& r, const hit_record& rec) {
+				if (!use_reflection && !use_refraction) {
+					return;
+				}
+				ray scattered;
+				color attenuation;
+				if (rec.mat->scatter(r, rec, attenuation, scattered)) {
+					//check what the ray hits
+					color scattered_color = ray_color(scattered, world, this->max_depth - 1, env);
+
+					//limit maximum luma for reflection/refraction to avoid fireflies
+					double luma = 0.2126 * scattered_color.length();
+					double max_luma = 2.0; //maximum luma threshold
+					if (luma > max_luma) {
+						scattered_color *= (max_luma / luma);
+					}
+					//divide into buffers depending on material type
+					//scattered ray has almost the same direction as the perfect reflection:
+					vec3 reflected_dir = reflect(unit_vector(r.direction()), unit_vector(rec.normal));
+					bool is_specular = dot(unit_vector(scattered.direction()), reflected_dir) > 0.9;
+
+					if (is_specular) {
+						px.reflection += attenuation * scattered_color;
+					} else if (dot(scattered.direction(), rec.normal) < 0) {
+						//if not mirror check if glass 
+						px.refraction += attenuation * scattered_color;
+					}
+				}
+			};
+
+			auto add_beauty = [](pixel_sums& px, const color& sample_color) {
+				px.beauty += sample_color;
+				px.luminance_sq += sample_color.luminance() * sample_color.luminance();
+			};
+
+			//camera ray that left the scene
+			auto miss_sample = [&](pixel_sums& px, const ray& r, int s) {
+				//background for Beauty Pass
+				add_beauty(px, get_background_color(r, env));
+				if (s < aux_sample) {
+					if (use_normal_buffer) {
+						px.normal += color(0.5, 0.5, 1.0);
+					}
+				}
+			};
 
-			const int aux_sample = std::clamp(samples_per_pixel / 8, 64, 1024); //for albedo, normals, zdepth
-			const int light_pass_sample = samples_per_pixel; //for reflection/refraction
+			//one sample: shading of the first hit (found by the packet) and the passes, secondary rays are single rays
+			auto shade_sample = [&](pixel_sums& px, const ray& r, bool hit, hit_record& rec, int s) {
+				if (hit) {
+					//beauty pass
+					add_beauty(px, ray_color_from_hit(r, rec, world, max_depth, env));
 
-			const double aux_scale = 1.0 / aux_sample;
-			const double light_scale = 1.0 / light_pass_sample;
+					//get datas (render passes: Albedo, Normals, Z-Depth) from the first hit
+					first_hit_passes(px, rec, s);
+					light_passes(px, r, rec);
+				} else {
+					miss_sample(px, r, s);
+				}
+			};
 
-			for (int j = start_y; j < end_y; ++j) {
-				//check if rendering should stop
-				if (!render_flag.load()) {
-					return;
+			//write the sums of this pass into the pixel buffers of a packet block
+			auto store_block = [&](int x0, int y0, int cols, int rows, const pixel_sums* sums) {
+				for (int k = 0; k < rows * cols; k++) {
+					//average all the buffers
+					int idx = pixel_index(x0, y0, cols, k);
+					blend(framebuffer[idx], sums[k].beauty, n_before, n_after);
+					blend(reflection_buffer[idx], sums[k].reflection, n_before, n_after);
+					blend(refraction_buffer[idx], sums[k].refraction, n_before, n_after);
+
+					//albedo, normals, z-depth are averaged over their first aux_sample samples
+					blend(albedo_buffer[idx], sums[k].albedo, aux_before, aux_after);
+					blend(normal_buffer[idx], sums[k].normal, aux_before, aux_after);
+					blend(z_depth_buffer[idx], sums[k].zdepth, aux_before, aux_after);
+
+					luminance_sq[idx] = static_cast<float>((luminance_sq[idx] * n_before + sums[k].luminance_sq) / n_after);
+					sample_count[idx] = n_after;
+				}
+			};
+
+			//wavefront batch: paths of the queued blocks (max_packet_size sum slots per block), traced together
+			//once it holds wavefront_batch_paths paths; the blocks are stored after the batch is traced
+			path_queue paths;
+			std::vector<render_tile> batch_blocks;
+			std::vector<pixel_sums> batch_sums;
+			std::vector<ray> light_rays; //first ray and hit of every path, only kept for the light passes
+			std::vector<hit_record> light_recs;
+			wavefront_integrator integrator;
+			integrator.max_depth = max_depth;
+			integrator.lights = sample_lights ? &lights : nullptr;
+
+			auto flush_batch = [&]() {
+				integrator.trace(world, paths, [&](const ray& r, double mis_weight) { return get_background_color(r, env, mis_weight); });
+
+				pcg32& rng = thread_rng();
+				pixel_sampler& path_sampler = thread_sampler();
+				for (int p = 0; p < paths.size(); p++) {
+					pixel_sums& px = batch_sums[paths.owners[p]];
+					add_beauty(px, paths.radiance[p]);
+					if (use_reflection || use_refraction) {
+						//the light passes continue the sample's random sequence where the beauty path ended
+						rng = paths.rngs[p];
+						path_sampler = paths.samplers[p];
+						light_passes(px, light_rays[p], light_recs[p]);
+					}
 				}
 
-				for (int i = 0; i < image_width; ++i) {
-					color pixel_color(0.0, 0.0, 0.0);
-					color pixel_albedo(0.0, 0.0, 0.0);
-					color pixel_normal(0.0, 0.0, 0.0);
-					color pixel_reflection(0.0, 0.0, 0.0);
-					color pixel_refraction(0.0, 0.0, 0.0);
-					color pixel_zdepth(0.0, 0.0, 0.0);
-
-					//sampling loop for each pixel 
-					for (int s = 0; s < samples_per_pixel; s++) {
-						ray r = get_ray(i, j);
-						hit_record rec;
-
-						//only one collision test for the main ray
-						if (world.hit(r, interval(0.001, infinity), rec)) {
-							//beauty pass
-							pixel_color += ray_color_from_hit(r, rec, world, max_depth, env);
-
-							//get datas (render passes: Albedo, Normals, Z-Depth) from the first hit
-							if (s < aux_sample) {
-								// - albedo 
-								if (use_albedo_buffer) {
-									pixel_albedo += rec.mat->get_albedo(rec);
-								}
-								// - normals
-								if (use_normal_buffer) {
-									vec3 n = unit_vector(rec.normal);
-									//transition on camera space(view space)
-									double nx = dot(n, u);
-									double ny = dot(n, v);
-									double nz = dot(n, w);
-									//mapping to range[0,1]
-									pixel_normal += color(
-										(nx + 1.0) * 0.5,
-										(ny + 1.0) * 0.5,
-										(nz + 1.0) * 0.5
-									);
-								}
-								// - Z-Depth
-								if (use_z_depth_buffer) {
-									double z_depth = 1.0 - std::clamp(rec.t / z_depth_max_dist, 0.0, 1.0);
-									pixel_zdepth += color(z_depth, z_depth, z_depth);
+				long long batch_pixels = 0;
+				for (size_t b = 0; b < batch_blocks.size(); b++) {
+					const render_tile& block = batch_blocks[b];
+					store_block(block.x0, block.y0, block.x1 - block.x0, block.y1 - block.y0, &batch_sums[b * max_packet_size]);
+					batch_pixels += block.pixel_count();
+				}
+				//progress bar
+				this->samples_rendered.fetch_add(batch_pixels * pass_samples);
+
+				paths.clear();
+				batch_blocks.clear();
+				batch_sums.clear();
+				light_rays.clear();
+				light_recs.clear();
+			};
+
+			//deadline render: after the first pass no tile is started past passes_end
+			auto out_of_time = [&]() {
+				return deadline_mode && n_before > 0 && std::chrono::steady_clock::now() > passes_end;
+			};
+
+			render_tile tile;
+			while (render_flag.load() && scheduler->next(thread_index, tile)) {
+				if (out_of_time()) {
+					pass_cut_off = true;
+					break;
+				}
+				for (int tile_y = tile.y0; tile_y < tile.y1; tile_y += tile_h) {
+					//check if rendering should stop
+					if (!render_flag.load()) {
+						break;
+					}
+					int rows = std::min(tile_h, tile.y1 - tile_y);
+					int traced_pixels = 0;
+
+					for (int tile_x = tile.x0; tile_x < tile.x1; tile_x += tile_w) {
+						int cols = std::min(tile_w, tile.x1 - tile_x);
+						int count = rows * cols;
+
+						//converged blocks get no more samples, the rest of their budget counts as done for the progress bar
+						int block_idx = tile_y * image_width + tile_x;
+						if (adaptive_sampling) {
+							if (converged[block_idx]) {
+								continue;
+							}
+							if (block_converged(tile_x, tile_y, cols, rows)) {
+								converged[block_idx] = 1;
+								this->samples_skipped.fetch_add(static_cast<long long>(count) * (max_samples - n_before));
+								continue;
+							}
+						}
+						block_count++;
+						traced_pixels += count;
+
+						//wavefront: the block's sums live in the batch until the batch is traced
+						pixel_sums block_sums[max_packet_size];
+						pixel_sums* sums = block_sums;
+						if (use_wavefront) {
+							batch_blocks.push_back({ tile_x, tile_y, tile_x + cols, tile_y + rows });
+							batch_sums.resize(batch_blocks.size() * max_packet_size);
+							sums = &batch_sums[(batch_blocks.size() - 1) * max_packet_size];
+						}
+						ray rays[max_packet_size];
+						hit_record recs[max_packet_size];
+						bool hits[max_packet_size];
+
+						//sampling loop, every sample traces the camera rays of the whole tile together
+						//(random numbers come from seeds per pixel and sample, independent of thread and pass)
+						for (int s = n_before; s < n_after; s++) {
+							for (int k = 0; k < count; k++) {
+								seed_thread_rng(pixel_index(tile_x, tile_y, cols, k), s, frame_index);
+								thread_sampler().start(sampler, tile_x + k % cols, tile_y + k / cols, s, max_samples, frame_index);
+								rays[k] = get_ray(tile_x + k % cols, tile_y + k / cols);
+							}
+							seed_thread_rng(block_idx, s, frame_index, 1); //media sampled during the traversal
+
+							auto trace_start = std::chrono::steady_clock::now();
+							if (packet > 1) {
+								world.hit_packet(rays, count, interval(0.001, infinity), recs, hits);
+							} else {
+								for (int k = 0; k < count; k++) {
+									hits[k] = world.hit(rays[k], interval(0.001, infinity), recs[k]);
 								}
 							}
-
-							//reflection and refraction
-							//use 'rec' from the first hit
-							if (use_reflection || use_refraction) {
-								ray scattered;
-								color attenuation;
-								if (rec.mat->scatter(r, rec, attenuation, scattered)) {
-									//check what the ray hits
-									color scattered_color = ray_color(scattered, world, this->max_depth - 1, env);
-
-									//limit maximum luma for reflection/refraction to avoid fireflies
-									double luma = 0.2126 * scattered_color.length();
-									double max_luma = 2.0; //maximum luma threshold
-									if (luma > max_luma) {
-										scattered_color *= (max_luma / luma);
-									}
-									//divide into buffers depending on material type
-									//scattered ray has almost the same direction as the perfect reflection:
-									vec3 reflected_dir = reflect(unit_vector(r.direction()), unit_vector(rec.normal));
-									bool is_specular = dot(unit_vector(scattered.direction()), reflected_dir) > 0.9;
-
-									if (is_specular) {
-										pixel_reflection += attenuation * scattered_color;
-									} else if (dot(scattered.direction(), rec.normal) < 0) {
-										//if not mirror check if glass 
-										pixel_refraction += attenuation * scattered_color;
+							primary_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start).count();
+							primary_rays += count;
+
+							for (int k = 0; k < count; k++) {
+								seed_thread_rng(pixel_index(tile_x, tile_y, cols, k), s, frame_index, 2);
+								thread_sampler().start(sampler, tile_x + k % cols, tile_y + k / cols, s, max_samples, frame_index, camera_dimensions);
+								if (!use_wavefront) {
+									shade_sample(sums[k], rays[k], hits[k], recs[k], s);
+								} else if (hits[k]) {
+									//the rest of the path is traced by the wavefront stages
+									first_hit_passes(sums[k], recs[k], s);
+									paths.add_hit(rays[k], recs[k], static_cast<int>(sums - batch_sums.data()) + k);
+									if (use_reflection || use_refraction) {
+										light_rays.push_back(rays[k]);
+										light_recs.push_back(recs[k]);
 									}
+								} else {
+									miss_sample(sums[k], rays[k], s);
 								}
 							}
-						} else {
-							//background for Beauty Pass
-							pixel_color += get_background_color(r, env);
-							if (s < aux_sample) {
-								if (use_normal_buffer) {
-									pixel_normal += color(0.5, 0.5, 1.0);
-								}
+						}
+
+						if (use_wavefront) {
+							if (paths.size() >= wavefront_batch_paths) {
+								flush_batch();
 							}
+							continue;
 						}
+						store_block(tile_x, tile_y, cols, rows, sums);
 					}
+					//progress bar (wavefront batches count when they are traced)
+					if (!use_wavefront) {
+						this->samples_rendered.fetch_add(static_cast<long long>(traced_pixels) * pass_samples);
+					}
+				}
+			}
+			//trace what is left in the batch (a cancelled render drops it, those pixels keep their previous mean)
+			if (use_wavefront && !batch_blocks.empty() && render_flag.load()) {
+				flush_batch();
+			}
+			active_blocks.fetch_add(block_count);
 
-					//average all the buffers
-					int idx = j * image_width + i;
-					framebuffer[idx] = pixel_color * light_scale; //average by all the samples
-					reflection_buffer[idx] = pixel_reflection * light_scale;
-					refraction_buffer[idx] = pixel_refraction * light_scale;
-
-					int actual_aux_samples = std::min(aux_sample, samples_per_pixel);
-					double dynamic_aux_scale = 1.0 / actual_aux_samples;
+			primary_ns_total.fetch_add(primary_ns);
+			primary_rays_total.fetch_add(primary_rays);
+			finish_ms[thread_index] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pass_start).count();
+		};
 
-					//average albedo, normals, z-depth passes dynamic_aux_scale
-					albedo_buffer[idx] = pixel_albedo * dynamic_aux_scale;
-					normal_buffer[idx] = pixel_normal * dynamic_aux_scale;
-					z_depth_buffer[idx] = pixel_zdepth * dynamic_aux_scale;
+		//passes over the whole frame until samples_per_pixel (or the time limit / deadline) is reached
+		auto render_start = std::chrono::steady_clock::now();
+		std::vector<double> idle_ms(num_threads, 0.0);
+		int tile_count = 0;
+		double last_pass_ms = 0.0;
+		while (render_flag.load() && first_sample < max_samples) {
+			auto now = std::chrono::steady_clock::now();
+			double elapsed = std::chrono::duration<double>(now - render_start).count();
+			if (first_sample > 0 && time_limit_seconds > 0.0 && elapsed >= time_limit_seconds) {
+				break;
+			}
+			//deadline render: a pass is only started if it should end (as long as the last one took) before passes_end
+			if (deadline_mode && first_sample > 0 && now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double, std::milli>(last_pass_ms)) > passes_end) {
+				break;
+			}
+			//adaptive sampling without progressive passes checks the error every adaptive_min_samples samples
+			pass_samples = (progressive || deadline_mode) ? 1 : (adaptive_sampling ? std::max(1, adaptive_min_samples) : samples_per_pixel);
+			pass_samples = std::min(pass_samples, max_samples - first_sample);
+			active_blocks = 0;
+			pass_cut_off = false;
+
+			tile_scheduler pass_scheduler(image_width, image_height, render_tile_size, num_threads);
+			scheduler = &pass_scheduler;
+			tile_count = pass_scheduler.tile_count();
+			pass_start = std::chrono::steady_clock::now();
+
+			//one render_tiles call per pool thread, the work is handed out by the scheduler
+			global_thread_pool().parallel_for(num_threads, render_tiles, 1);
+
+			//idle time = time between a thread running out of work and the end of the pass
+			double pass_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pass_start).count();
+			for (int t = 0; t < num_threads; t++) {
+				idle_ms[t] += std::max(0.0, pass_ms - finish_ms[t]);
+			}
+			last_pass_ms = pass_ms;
 
+			update_sample_heatmap(deadline_mode ? first_sample + pass_samples : max_samples);
 
-				}
-				//increase the local counter for progress bar
-				local_lines_done++;
-				//every 10 lines update progress bar
-				if (local_lines_done % 10 == 0 || j == end_y - 1) {
-					//fetch_add for atomic safety 
-					this->lines_rendered.fetch_add(local_lines_done);
-					local_lines_done = 0; //reset locally
-				}
+			if (!render_flag.load()) {
+				break; //cancelled pass: some pixels have one sample more, the image stays complete
 			}
-		};
+			if (pass_cut_off.load()) {
+				break; //pass cut off at the deadline, same as a cancelled pass
+			}
+			if (active_blocks.load() == 0) {
+				break; //every pixel block converged
+			}
+			first_sample += pass_samples;
+			this->current_samples_count = first_sample; //the preview refreshes when this changes
+		}
 
-		//split the work between threads
-		int rows_per_thread = image_height / num_threads;
-		int extra = image_height % num_threads;
-		int start = 0;
+		//camera rays per second of one thread (time spent in the first intersection only)
+		if (primary_ns_total.load() > 0) {
+			primary_rays_per_second = primary_rays_total.load() / (primary_ns_total.load() * 1e-9);
+		}
+		primary_packet_size = packet;
 
-		//create threads with their assigned block of rows
-		for (int t = 0; t < num_threads; ++t) {
-			int end = start + rows_per_thread + (t < extra ? 1 : 0);
-			threads.emplace_back(render_rows, start, end);
-			start = end;
+		//samples actually traced per pixel (lower than samples_per_pixel with adaptive sampling)
+		long long traced_total = 0;
+		for (int n : sample_count) {
+			traced_total += n;
+		}
+		average_samples_per_pixel = pixel_count > 0 ? static_cast<double>(traced_total) / pixel_count : 0.0;
+		if (adaptive_sampling) {
+			std::cerr << "Adaptive sampling: " << average_samples_per_pixel << " spp on average (max " << max_samples << ")\n";
 		}
 
-		//join threads - finished
-		for (auto& th : threads) {
-			if (th.joinable()) {
-				th.join();
-			}
+		//load balance summed over the passes
+		render_wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+		render_tile_count = tile_count;
+		thread_idle_ms = idle_ms;
+		double idle_max = 0.0;
+		double idle_sum = 0.0;
+		for (int t = 0; t < num_threads; t++) {
+			idle_max = std::max(idle_max, thread_idle_ms[t]);
+			idle_sum += thread_idle_ms[t];
 		}
+		std::cerr << "Scheduler: " << render_tile_count << " tiles, thread idle max " << idle_max << " ms, avg "
+			<< idle_sum / num_threads << " ms (render " << render_wall_ms << " ms)\n";
+	}
 
-		//final 100% while loop finished
-		if (render_flag.load()) {
-			this->lines_rendered = image_height; //force 100% for GUI
+	//framebuffer index of pixel k of a packet block whose upper left pixel is (x0, y0)
+	int pixel_index(int x0, int y0, int cols, int k) const {
+		return (y0 + k / cols) * image_width + x0 + k % cols;
+	}
+
+	//samples per pixel as a blue (none) to red (max_samples) ramp for the heatmap pass
+	void update_sample_heatmap(int max_samples) {
+		sample_heatmap_buffer.resize(sample_count.size());
+		double scale = 1.0 / std::max(1, max_samples);
+		for (size_t i = 0; i < sample_count.size(); i++) {
+			double t = std::clamp(sample_count[i] * scale, 0.0, 1.0);
+			sample_heatmap_buffer[i] = color(t, 1.0 - std::abs(2.0 * t - 1.0), 1.0 - t);
 		}
 	}
 
@@ -605,7 +1040,7 @@ private:
 			return static_cast<float>(v);
 		};
 
-		for (size_t i = 0; i < framebuffer.size(); ++i) {
+		parallel_for((int)framebuffer.size(), [&](int i) {
 			f_color[i * 3 + 0] = static_cast<float>(framebuffer[i].x());
 			f_color[i * 3 + 1] = static_cast<float>(framebuffer[i].y());
 			f_color[i * 3 + 2] = static_cast<float>(framebuffer[i].z());
@@ -618,7 +1053,7 @@ private:
 			f_normal[i * 3 + 0] = clean_val(normal_buffer[i].x());
 			f_normal[i * 3 + 1] = clean_val(normal_buffer[i].y());
 			f_normal[i * 3 + 2] = clean_val(normal_buffer[i].z());
-		}
+		});
 
 		//OIDN Buffer for full GPU/CPU compatibility
 		size_t bufferSize = static_cast<size_t>(width) * height * 3 * sizeof(float);
@@ -760,9 +1195,9 @@ private:
 					pix_color = pp.process(pix_color, u, v, render_pass::RGB);
 				} else {
 					pix_color = color(
-						std::clamp(pix_color.x(), 0.0, 1.0),
-						std::clamp(pix_color.y(), 0.0, 1.0),
-						std::clamp(pix_color.z(), 0.0, 1.0));
+						std::clamp<double>(pix_color.x(), 0.0, 1.0),
+						std::clamp<double>(pix_color.y(), 0.0, 1.0),
+						std::clamp<double>(pix_color.z(), 0.0, 1.0));
 
 					if (apply_gamma) {
 						pix_color = linear_to_gamma(pix_color);
@@ -815,17 +1250,20 @@ private:
 
 	//returns the vector to a random point in the [-0.5, -0.5]-[0.5, 0.5] unit square
 	vec3 sample_square() const {
-		return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+		double u, v;
+		thread_sampler().get_2d(u, v);
+		return vec3(u - 0.5, v - 0.5, 0);
 	}
 
 	//returns a random point in the camera defocus disk
 	point3 defocus_disk_sample() const {
-		auto p = random_in_unit_disk();
+		auto p = sampled_in_unit_disk();
 		return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 	}
 
 	//returns the background color based on the ray direction and environment settings
-	color get_background_color(const ray& r, const EnvironmentSettings& env) const {
+	//(mis_weight scales the sun disc or the HDR map, the MIS weight of a ray leaving a light-sampled surface)
+	color get_background_color(const ray& r, const EnvironmentSettings& env, double mis_weight = 1.0) const {
 		vec3 unit_dir = unit_vector(r.direction());
 
 		//solid color background
@@ -833,99 +1271,42 @@ private:
 			return env.background_color * env.intensity;
 		}
 
-		//HDR map background
+		//HDR map background, rotation baked in render()
 		if (env._mode == EnvironmentSettings::HDR_MAP) {
-			if (!env.hdr_texture) {
-				return color(0.0, 0.0, 0.0);
-			}
-			vec3 d = unit_dir;
-
-			//yaw HDR rotation (Y-axis) 
-			double cos_y = cos(env.hdri_rotation);
-			double sin_y = sin(env.hdri_rotation);
-			double x1 = cos_y * d.x() + sin_y * d.z();
-			double z1 = -sin_y * d.x() + cos_y * d.z();
-			d = vec3(x1, d.y(), z1);
-
-			//pitch/tilt (X-axis) - up/down tilt
-			double cos_p = cos(env.hdri_tilt);
-			double sin_p = sin(env.hdri_tilt);
-			double y2 = cos_p * d.y() - sin_p * d.z();
-			double z2 = sin_p * d.y() + cos_p * d.z();
-			d = vec3(d.x(), y2, z2);
-
-			//roll (Z-axis)  
-			double cos_r = cos(env.hdri_roll);
-			double sin_r = sin(env.hdri_roll);
-			double x3 = cos_r * d.x() - sin_r * d.y();
-			double y3 = sin_r * d.x() + cos_r * d.y();
-			d = vec3(x3, y3, d.z());
-
-
-			//uv mapping
-			auto phi = atan2(d.z(), d.x()) + pi;
-			auto theta = acos(std::clamp(d.y(), -1.0, 1.0));
-
-			return env.hdr_texture->value(phi / (2 * pi), theta / pi, point3(0.0, 0.0, 0.0)) * env.intensity;
-		}
-		//physcial sun model
-		//
-		// normalize sun direction locally 
-		vec3 sun_dir = unit_vector(env.sun_direction);
-		//day and night parameters
-		double sun_height = sun_dir.y();
-		double adjusted_height = sun_height - 0.05;
-		//sun height 0.0 -> exposure 1.0, 
-		//sun height -0.15 -> exposure 0.0
-		double sky_exposure = std::clamp(adjusted_height * 8.0 + 1.4, 0.0, 1.0);
-		double day_factor = std::clamp(adjusted_height * 10.0 + 1.1, 0.0, 1.0);
-
-		double sunset_intensity = std::clamp(1.0 - std::abs(adjusted_height + 0.05) * 30.0, 0.0, 1.0);
-		double sunset_factor = (adjusted_height > -0.1) ? sunset_intensity : 0.0;
-		//tone down sunset below horizon
-		if (sun_height < 0) {
-			sunset_factor *= (sun_height * 10.0 + 1.0);
-		}
-		sunset_factor = std::clamp(sunset_factor, 0.0, 1.0);
-
-		//sky colors
-		color zenit_color = color(0.01, 0.03, 0.1) * (1.0 - day_factor) + color(0.2, 0.5, 1.0) * day_factor;
-		color horizon_color = color(0.05, 0.02, 0.01) * (1.0 - day_factor) + color(0.6, 0.8, 1.0) * day_factor;
-		//sunset horizon
-		horizon_color = horizon_color * (1.0 - sunset_factor) + color(1.0, 0.35, 0.1) * sunset_factor;
-		//sky gradient
-		auto a = unit_dir.y();
-		color sky_color;
-
-		if (a > 0.0) {
-			sky_color = (1.0 - a) * horizon_color + a * zenit_color;
-		}
-		else {
-			// Dla dołu (pod horyzontem) dajemy ciemniejszy kolor horyzontu
-			sky_color = horizon_color * 0.1;
-		}
-		color final_color = sky_color * (env.intensity * 1.5) * sky_exposure;
-
-		//sun disc(physical)
-		double sun_focus = dot(unit_dir, sun_dir);
-		//sun_size parameter in UI 0.1(small) - 2.0(big)
-		// Próg tarczy słońca (używamy Twojego sun_size)
-		// Zakładamy, że w UI sun_size to np. 1.0 (małe) do 10.0 (duże)
-		double sun_threshold = 1.0 - (env.sun_size * 0.001);
-
-		if (sun_focus > sun_threshold && adjusted_height > -0.1) {
-			color s_color = env.sun_color * (1.0 - sunset_factor) + color(1.0, 0.3, 0.1) * sunset_factor;
-			double visibility = std::clamp(sun_height * 5.0 + 1.0, 0.0, 1.0);
-			//antyaliasing sun edges
-			double alpha = smoothstep(sun_threshold, sun_threshold + 0.0002, sun_focus);
-
-			final_color += s_color * env.sun_intensity * visibility * alpha;
-		}
-		return final_color;
+			return hdr_background.radiance(unit_dir) * mis_weight;
+		}
+		//physcial sun model, baked for the current settings in render()
+		return sky.radiance(unit_dir, mis_weight);
+	}
+
+	//MIS weight of emission found by ray r, bsdf_pdf = density the previous surface scattered r with
+	//(0 = camera ray or specular surface, no light sampling there and the emission counts fully)
+	double emission_weight(const ray& r, const hit_record& rec, double bsdf_pdf) const {
+		return sample_lights ? lights.emission_weight(r.origin(), rec, bsdf_pdf) : 1.0;
+	}
+
+	double environment_weight(const ray& r, double bsdf_pdf) const {
+		return sample_lights ? lights.environment_weight(r.direction(), bsdf_pdf) : 1.0;
+	}
+
+	//direct light at a hit (one light sample with a shadow ray), black without light sampling or on specular surfaces
+	color direct_light(const ray& r, const hit_record& rec, const hittable& world) const {
+		return sample_lights ? lights.sample_direct(world, r, rec) : color(0.0, 0.0, 0.0);
+	}
+
+	//density of scattered under the material at rec if the light was sampled there, 0 otherwise
+	double scatter_pdf(const ray& r_in, const hit_record& rec, const ray& scattered) const {
+		color f_cos;
+		double pdf = 0.0;
+		if (!sample_lights || !rec.mat->eval_scatter(r_in, rec, unit_vector(scattered.direction()), f_cos, pdf)) {
+			return 0.0;
+		}
+		return pdf;
 	}
 
 	//get ray and check the hit 
-	color ray_color(const ray& r, const hittable& world, int depth, const EnvironmentSettings& env) const {
+	//(bsdf_pdf: density the previous surface scattered r with, weights the light it finds, see emission_weight)
+	color ray_color(const ray& r, const hittable& world, int depth, const EnvironmentSettings& env, double bsdf_pdf = 0.0) const {
 		color accumulated_light(0.0, 0.0, 0.0);
 		color accumulated_attenuation(1, 1, 1);
 		ray cur_ray = r;
@@ -938,7 +1319,7 @@ private:
 				if (global_settings::bvh_debug_mode) {
 					return accumulated_light;
 				}
-				return accumulated_light + accumulated_attenuation * get_background_color(cur_ray, env);
+				return accumulated_light + accumulated_attenuation * get_background_color(cur_ray, env, environment_weight(cur_ray, bsdf_pdf));
 			}
 
 			//emission
@@ -954,7 +1335,8 @@ private:
 			}
 
 			//in normal mode, we add emission to the light pool
-			accumulated_light += accumulated_attenuation * emitted;
+			accumulated_light += accumulated_attenuation * emitted * emission_weight(cur_ray, rec, bsdf_pdf);
+			accumulated_light += accumulated_attenuation * direct_light(cur_ray, rec, world);
 
 			//scatter
 			ray scattered;
@@ -962,6 +1344,7 @@ private:
 
 			if (rec.mat->scatter(cur_ray, rec, attenuation, scattered)) {
 				accumulated_attenuation *= attenuation;
+				bsdf_pdf = scatter_pdf(cur_ray, rec, scattered);
 				cur_ray = scattered;
 
 				//early termination for very weak rays
@@ -976,7 +1359,7 @@ private:
 			if (i > 10) {
 				double p = std::max({ accumulated_attenuation.x(), accumulated_attenuation.y(), accumulated_attenuation.z() });
 				p = std::clamp(p, 0.05, 0.95);
-				if (random_double() > p) {
+				if (sampled_double() > p) {
 					break;
 				}
 				accumulated_attenuation /= p;
@@ -988,6 +1371,7 @@ private:
 	//optimazed ray_color (skip first collision test)
 	color ray_color_from_hit(const ray& r, const hit_record& first_rec, const hittable& world, int depth, const EnvironmentSettings& env) const {
 		color accumulated_light = first_rec.mat->emitted(first_rec.u, first_rec.v, first_rec.p);
+		accumulated_light += direct_light(r, first_rec, world);
 		color accumulated_attenuation(1.0, 1.0, 1.0);
 
 		ray scattered;
@@ -997,7 +1381,7 @@ private:
 		if (first_rec.mat->scatter(r, first_rec, attenuation, scattered)) {
 			accumulated_attenuation *= attenuation;
 			//continue with the rest of the ray bounces
-			return accumulated_light + accumulated_attenuation * ray_color(scattered, world, depth - 1, env);
+			return accumulated_light + accumulated_attenuation * ray_color(scattered, world, depth - 1, env, scatter_pdf(r, first_rec, scattered));
 		}
 
 		return accumulated_light;
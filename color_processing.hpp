@@ -81,9 +81,9 @@ public:
 		if (!is_beauty_pass && !debug.any_active()) {
 			//for Z-Depth save clamp and gamma for and overview
 			return linear_to_gamma(color(
-				std::clamp(exposed_color.x(), 0.0, 1.0),
-				std::clamp(exposed_color.y(), 0.0, 1.0),
-				std::clamp(exposed_color.z(), 0.0, 1.0)
+				std::clamp<double>(exposed_color.x(), 0.0, 1.0),
+				std::clamp<double>(exposed_color.y(), 0.0, 1.0),
+				std::clamp<double>(exposed_color.z(), 0.0, 1.0)
 			));
 		}
 
@@ -140,9 +140,9 @@ public:
 		}
 
 		return linear_to_gamma(color(
-			std::clamp(c.x(), 0.0, 1.0),
-			std::clamp(c.y(), 0.0, 1.0),
-			std::clamp(c.z(), 0.0, 1.0)
+			std::clamp<double>(c.x(), 0.0, 1.0),
+			std::clamp<double>(c.y(), 0.0, 1.0),
+			std::clamp<double>(c.z(), 0.0, 1.0)
 		));
 	}
 
@@ -6,10 +6,20 @@
 #include <random>
 #include <algorithm>
 
+#include "rng.hpp"
+
 //c++ std usings
 using std::make_shared;
 using std::shared_ptr;
 
+//scalar of vectors, rays and hit records: double by default, float with ZENITH_SINGLE_PRECISION
+//(half the memory per pixel buffer and per ray, code that needs double converts locally)
+#ifdef ZENITH_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 //constants
 constexpr double infinity = std::numeric_limits<double>::infinity();
 constexpr double pi = 3.14159265358979323846;
@@ -25,12 +35,9 @@ inline double radians_to_degrees(double radians) {
 	return radians * 180.0 / pi;
 }
 
-//generates a random double between 0 and 1
+//generates a random double between 0 and 1 (per-thread PCG32, see rng.hpp)
 inline double random_double() {
-	static std::random_device rd;  //random device
-	static std::mt19937 gen(rd()); //mersenne Twister random number generator
-	std::uniform_real_distribution<> dis(0.0, 1.0); //uniform distribution [0,1)
-	return dis(gen);
+	return thread_rng().next_double();
 }
 
 //generates a random double between `min` and `max`
@@ -90,6 +97,34 @@ inline double smoothstep(double edge0, double edge1, double x) {
 	return x * x * (3 - 2 * x);
 }
 
+//atan2 from a degree-9 odd polynomial on [0, 1] and octant folding, max error 1e-5 rad
+//(below 2% of a pixel of an 8k equirect map, no libm call and no loops, so it vectorizes)
+inline double fast_atan2(double y, double x) {
+	double ax = std::abs(x);
+	double ay = std::abs(y);
+	double t = std::min(ax, ay) / std::max({ ax, ay, 1e-300 });
+	double t2 = t * t;
+	double r = t * (0.9998660 + t2 * (-0.3302995 + t2 * (0.1801410 + t2 * (-0.0851330 + t2 * 0.0208351))));
+	r = (ay > ax) ? 0.5 * pi - r : r;
+	r = (x < 0.0) ? pi - r : r;
+	return (y < 0.0) ? -r : r;
+}
+
+//acos for x in [-1, 1] (Abramowitz & Stegun 4.4.46), max error 2e-8 rad
+inline double fast_acos(double x) {
+	double ax = std::abs(x);
+	double p = -0.0012624911;
+	p = p * ax + 0.0066700901;
+	p = p * ax - 0.0170881256;
+	p = p * ax + 0.0308918810;
+	p = p * ax - 0.0501743046;
+	p = p * ax + 0.0889789874;
+	p = p * ax - 0.2145988016;
+	p = p * ax + 1.5707963050;
+	double r = std::sqrt(1.0 - ax) * p;
+	return (x < 0.0) ? pi - r : r;
+}
+
 //convert spherical coordinates(degrees) to directional vectors
 inline vec3 direction_from_spherical(double elevation_deg, double azimuth_deg) {
 	double phi = degrees_to_radians(azimuth_deg);
@@ -114,13 +149,30 @@ enum class render_pass : int {
 	NORMALS,
 	REFLECTIONS,
 	REFRACTIONS, 
-	Z_DEPTH
+	Z_DEPTH,
+	SAMPLE_HEATMAP
+};
+
+//memory layout of the acceleration structure used for rendering
+enum class bvh_layout : int {
+	BINARY = 0,
+	WIDE_4,
+	WIDE_8
 };
 
 namespace global_settings {
 	inline bool bvh_debug_mode = false;
 	inline float bvh_thickness = 0.01f;
 	inline int debug_bvh_level = -1;
+
+	//BVH builder (binned SAH)
+	inline int bvh_sah_bins = 16; //candidate split planes per axis = bins - 1
+	inline int bvh_max_leaf_size = 4; //nodes with more primitives are always split
+	inline bvh_layout active_bvh_layout = bvh_layout::WIDE_8; //applied on the next scene rebuild
+
+	//shared worker pool (rendering, post-processing, BVH builds), applied before the next render
+	inline int worker_threads = 0; //0 = all hardware threads
+	inline bool pin_worker_threads = false; //one thread per core (Windows/Linux)
 }
 
 #include "color.hpp"
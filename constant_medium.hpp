@@ -17,6 +17,13 @@ public:
 		return true;
 	}
 
+	//isotropic phase function, the same 1 / (4 pi) as the uniform scatter direction
+	bool eval_scatter(const ray& r_in, const hit_record& rec, const vec3& direction, color& f_cos, double& pdf) const override {
+		pdf = 1.0 / (4.0 * pi);
+		f_cos = tex->value(rec.u, rec.v, rec.p) * pdf;
+		return true;
+	}
+
 private:
 	shared_ptr<texture> tex;
 };
@@ -72,6 +79,7 @@ public:
 		rec.normal = vec3(1, 0, 0);  //arbitrary, irrelevant when dispersed
 		rec.front_face = true;
 		rec.mat = phase_function;
+		rec.object = this;
 
 		return true;
 	}
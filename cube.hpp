@@ -49,24 +49,19 @@ public:
 
 		//loop "for" goes through each axis checking interesection
 		for (int i = 0; i < 3; ++i) {
-			//boundaries of cube in local space (centered at origin (0,0,0))
-			double min_local = -half_extents[i];
-			double max_local = half_extents[i];
-			//distances of intersections of radius with surfaces limting cube 
-			double invD = 1.0 / r.direction()[i];
-			double t0 = (min_local - r.origin()[i]) * invD;
-			double t1 = (max_local - r.origin()[i]) * invD;
-
-			if (invD < 0.0) {
-				std::swap(t0, t1);
-			}
+			//boundaries of cube in local space (centered at origin (0,0,0)), near plane first
+			double near_local = r.dir_neg[i] ? half_extents[i] : -half_extents[i];
+			//distances of intersections of radius with surfaces limting cube (cached inverse direction)
+			double t0 = (near_local - relative_origin[i]) * r.inv_dir[i];
+			double t1 = (-near_local - relative_origin[i]) * r.inv_dir[i];
+
 			tmin = std::fmax(t0, tmin);
 			tmax = std::fmin(t1, tmax);
+		}
 
-			//no interesection
-			if (tmax < tmin) {
-				return false;
-			}
+		//no interesection
+		if (tmax < tmin) {
+			return false;
 		}
 
 		//local intersection point and normal calculation
@@ -80,11 +75,50 @@ public:
 		set_cube_hit_data(local_p, rec);
 
 		rec.mat = mat; //assign cube material
+		rec.object = this;
 		rec.set_face_normal(r, rec.normal);
 
 		return true;
 	}
 
+	//uniform point on the 6 faces: u picks the face by its area and is reused inside the face
+	bool sample_surface(double u, double v, hit_record& rec, double& area_pdf) const override {
+		double area = surface_area();
+		if (area <= 0.0) {
+			return false;
+		}
+		const vec3& h = half_extents;
+		double face_area[3] = { 4.0 * h.y() * h.z(), 4.0 * h.x() * h.z(), 4.0 * h.x() * h.y() }; //faces normal to x, y, z
+		double pick = u * area;
+		int face = 0;
+		while (face < 5 && pick >= face_area[face / 2]) {
+			pick -= face_area[face / 2];
+			face++;
+		}
+		double s = std::clamp(pick / face_area[face / 2], 0.0, 1.0) * 2.0 - 1.0;
+		double t = v * 2.0 - 1.0;
+		double side = (face % 2 == 0) ? -1.0 : 1.0;
+
+		vec3 local_p;
+		if (face / 2 == 0) {
+			local_p = vec3(side * h.x(), s * h.y(), t * h.z());
+		} else if (face / 2 == 1) {
+			local_p = vec3(s * h.x(), side * h.y(), t * h.z());
+		} else {
+			local_p = vec3(s * h.x(), t * h.y(), side * h.z());
+		}
+		rec.p = center + local_p;
+		set_cube_hit_data(local_p, rec);
+		rec.mat = mat;
+		area_pdf = 1.0 / area;
+		return true;
+	}
+
+	double surface_pdf(const point3& p, const vec3& normal) const override {
+		double area = surface_area();
+		return (area > 0.0) ? 1.0 / area : 0.0;
+	}
+
 	void set_material(std::shared_ptr<material> m) {
 		mat = m;
 	}
@@ -96,6 +130,11 @@ private:
 	point3 min_p;
 	point3 max_p;
 
+	double surface_area() const {
+		const vec3& h = half_extents;
+		return 8.0 * (h.y() * h.z() + h.x() * h.z() + h.x() * h.y());
+	}
+
 	//function to set hit record data (normal, UV coordinates, tangent, bitangent)
 	void set_cube_hit_data(const vec3& p, hit_record& rec) const {
 		const double EPS = 1e-3;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//piecewise-constant density over [0,1)^2 from a grid of non-negative weights (row-major, row 0 at v = 0),
+//sampled with a marginal CDF over the rows and a conditional CDF inside every row
+class distribution_2d {
+public:
+	distribution_2d(const std::vector<float>& weights, int width, int height)
+		: width(width)
+		, height(height)
+		, conditional_cdf(static_cast<size_t>(width + 1) * height)
+		, marginal_cdf(height + 1)
+	{
+		marginal_cdf[0] = 0.0;
+		for (int j = 0; j < height; j++) {
+			const float* row = weights.data() + static_cast<size_t>(j) * width;
+			float* cdf = conditional_cdf.data() + static_cast<size_t>(j) * (width + 1);
+			double sum = 0.0;
+			for (int i = 0; i < width; i++) {
+				sum += row[i];
+			}
+			//running sum in double, normalized per row (a black row gets a uniform CDF, its marginal stays 0)
+			double running = 0.0;
+			cdf[0] = 0.0f;
+			for (int i = 0; i < width; i++) {
+				running += (sum > 0.0) ? row[i] : 1.0;
+				cdf[i + 1] = static_cast<float>(running / ((sum > 0.0) ? sum : width));
+			}
+			cdf[width] = 1.0f;
+			marginal_cdf[j + 1] = marginal_cdf[j] + sum;
+		}
+		total = marginal_cdf[height];
+		for (double& c : marginal_cdf) {
+			c = (total > 0.0) ? c / total : 0.0;
+		}
+		marginal_cdf[height] = 1.0;
+	}
+
+	//false if every weight is 0
+	bool valid() const {
+		return total > 0.0;
+	}
+
+	//point (u, v) from two uniform numbers, pdf with respect to area in [0,1)^2
+	bool sample(double u1, double u2, double& u, double& v, double& pdf) const {
+		if (!valid()) {
+			return false;
+		}
+		int j = find_interval(marginal_cdf.data(), height, u2);
+		double row_probability = marginal_cdf[j + 1] - marginal_cdf[j];
+		double dv = (u2 - marginal_cdf[j]) / row_probability;
+
+		const float* cdf = row_cdf(j);
+		int i = find_interval(cdf, width, u1);
+		double column_probability = static_cast<double>(cdf[i + 1]) - cdf[i];
+		double du = (u1 - cdf[i]) / column_probability;
+
+		u = std::clamp((i + du) / width, 0.0, 1.0);
+		v = std::clamp((j + dv) / height, 0.0, 1.0);
+		pdf = row_probability * column_probability * width * height;
+		return pdf > 0.0;
+	}
+
+	double pdf(double u, double v) const {
+		if (!valid()) {
+			return 0.0;
+		}
+		int i = std::clamp(static_cast<int>(u * width), 0, width - 1);
+		int j = std::clamp(static_cast<int>(v * height), 0, height - 1);
+		const float* cdf = row_cdf(j);
+		return (marginal_cdf[j + 1] - marginal_cdf[j]) * (static_cast<double>(cdf[i + 1]) - cdf[i]) * width * height;
+	}
+
+	//bytes of the CDF tables
+	size_t memory_size() const {
+		return conditional_cdf.size() * sizeof(float) + marginal_cdf.size() * sizeof(double);
+	}
+
+private:
+	int width, height;
+	std::vector<float> conditional_cdf; //width + 1 entries per row, float keeps a 4k map at 32 MB
+	std::vector<double> marginal_cdf; //height + 1 entries
+	double total = 0.0;
+
+	const float* row_cdf(int j) const {
+		return conditional_cdf.data() + static_cast<size_t>(j) * (width + 1);
+	}
+
+	//interval n of a CDF with count intervals such that cdf[n] <= x < cdf[n + 1] (empty intervals are skipped)
+	template <typename T>
+	static int find_interval(const T* cdf, int count, double x) {
+		int n = static_cast<int>(std::upper_bound(cdf, cdf + count + 1, x) - cdf) - 1;
+		return std::clamp(n, 0, count - 1);
+	}
+};
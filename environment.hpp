@@ -2,9 +2,43 @@
 
 #include "vec3.hpp"
 #include "texture.hpp"
+#include "distribution.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
 
 inline const std::string HDR_DIR = "assets/hdr_maps/";
 
+//loaded HDR map with its sampling distribution (luminance times sin(theta) per pixel, in map space)
+struct hdr_map {
+	shared_ptr<image_texture> texture;
+	shared_ptr<const distribution_2d> distribution;
+};
+
+//the last few HDR maps loaded, most recent first (switching back in the UI skips loading and the CDF build)
+inline std::vector<std::pair<std::string, hdr_map>>& hdr_cache() {
+	static std::vector<std::pair<std::string, hdr_map>> cache;
+	return cache;
+}
+
+inline constexpr size_t hdr_cache_size = 4;
+
+inline shared_ptr<const distribution_2d> build_hdr_distribution(const image_texture& texture) {
+	int width = texture.get_width();
+	int height = texture.get_height();
+	std::vector<float> weights(static_cast<size_t>(width) * height);
+	for (int j = 0; j < height; j++) {
+		//rows near the poles cover less solid angle
+		double sin_theta = std::sin(pi * (j + 0.5) / height);
+		for (int i = 0; i < width; i++) {
+			color c = texture.value((i + 0.5) / width, (j + 0.5) / height, point3(0.0, 0.0, 0.0));
+			weights[static_cast<size_t>(j) * width + i] = static_cast<float>(std::max(0.0, c.luminance() * sin_theta));
+		}
+	}
+	return make_shared<distribution_2d>(weights, width, height);
+}
+
 struct EnvironmentSettings {
 	enum Mode {
 		PHYSICAL_SUN,
@@ -41,6 +75,7 @@ struct EnvironmentSettings {
 	double hdri_roll = 0.0; //roll rotation in radians
 
 	shared_ptr<image_texture> hdr_texture = nullptr;
+	shared_ptr<const distribution_2d> hdr_distribution = nullptr; //importance sampling of hdr_texture
 
 	//loading hdr maps function
 	void load_hdr(const std::string& path) {
@@ -52,7 +87,23 @@ struct EnvironmentSettings {
 		}
 
 		try {
-			hdr_texture = make_shared<image_texture>(path.c_str(), true);
+			auto& cache = hdr_cache();
+			auto cached = std::find_if(cache.begin(), cache.end(), [&](const auto& entry) { return entry.first == path; });
+			if (cached != cache.end()) {
+				std::rotate(cache.begin(), cached, cached + 1);
+				hdr_texture = cache.front().second.texture;
+				hdr_distribution = cache.front().second.distribution;
+			} else {
+				hdr_texture = make_shared<image_texture>(path.c_str(), true);
+				hdr_distribution = nullptr;
+				if (hdr_texture->get_width() > 0) {
+					hdr_distribution = build_hdr_distribution(*hdr_texture);
+					cache.insert(cache.begin(), { path, hdr_map{ hdr_texture, hdr_distribution } });
+					if (cache.size() > hdr_cache_size) {
+						cache.pop_back();
+					}
+				}
+			}
 			//get map name
 			size_t last_slash = path.find_last_of("/\\");
 			current_hdr_name = (last_slash == std::string::npos) ? path : path.substr(last_slash + 1);
@@ -62,6 +113,7 @@ struct EnvironmentSettings {
 			set_mode(HDR_MAP);
 		}
 		catch (...) {
+			hdr_distribution = nullptr;
 			set_mode(SOLID_COLOR);
 			this->background_color = color(0.0, 0.0, 0.0);
 			std::cerr << "[Error] Could not load HDR. Falling back to black.\n";
@@ -74,4 +126,227 @@ struct EnvironmentSettings {
 	bool auto_sun_color = true;
 	double sun_intensity = 1.0;
 	double sun_size = 1.0;
-};
\ No newline at end of file
+
+	double sun_height() const {
+		return unit_vector(sun_direction).y();
+	}
+
+	//cosine of the angular radius of the sun disc (sun_size parameter in UI 0.1(small) - 2.0(big))
+	double sun_cos_max() const {
+		return 1.0 - (sun_size * 0.001);
+	}
+
+	//the disc is drawn until the sun is a bit below the horizon
+	bool sun_visible() const {
+		return _mode == PHYSICAL_SUN && sun_height() - 0.05 > -0.1 && sun_intensity > 0.0;
+	}
+
+	//orange tint of the sky and the sun near the horizon (0 = day, 1 = sunset)
+	double sunset_factor() const {
+		double sun_height = this->sun_height();
+		double adjusted_height = sun_height - 0.05;
+		double sunset_intensity = std::clamp(1.0 - std::abs(adjusted_height + 0.05) * 30.0, 0.0, 1.0);
+		double sunset_factor = (adjusted_height > -0.1) ? sunset_intensity : 0.0;
+		//tone down sunset below horizon
+		if (sun_height < 0) {
+			sunset_factor *= (sun_height * 10.0 + 1.0);
+		}
+		return std::clamp(sunset_factor, 0.0, 1.0);
+	}
+
+	//radiance of the physical sun disc seen in unit direction dir (black outside the disc),
+	//bakes the sky on every call, the render loops use a physical_sky built once per render
+	color sun_disc_radiance(const vec3& dir) const;
+
+	//world direction -> direction in the HDR map (yaw, then tilt, then roll), see hdr_environment for the cached matrix
+	vec3 to_map_direction(const vec3& dir) const {
+		vec3 d = dir;
+
+		//yaw HDR rotation (Y-axis)
+		double cos_y = cos(hdri_rotation);
+		double sin_y = sin(hdri_rotation);
+		d = vec3(cos_y * d.x() + sin_y * d.z(), d.y(), -sin_y * d.x() + cos_y * d.z());
+
+		//pitch/tilt (X-axis) - up/down tilt
+		double cos_p = cos(hdri_tilt);
+		double sin_p = sin(hdri_tilt);
+		d = vec3(d.x(), cos_p * d.y() - sin_p * d.z(), sin_p * d.y() + cos_p * d.z());
+
+		//roll (Z-axis)
+		double cos_r = cos(hdri_roll);
+		double sin_r = sin(hdri_roll);
+		return vec3(cos_r * d.x() - sin_r * d.y(), sin_r * d.x() + cos_r * d.y(), d.z());
+	}
+
+	//radiance of the HDR map seen in unit direction dir,
+	//bakes the rotation on every call, the render loops use an hdr_environment built once per render
+	color hdr_radiance(const vec3& dir) const;
+
+	//the HDR map can be importance sampled (HDR mode with a loaded map that isn't black)
+	bool hdr_sampling() const {
+		return _mode == HDR_MAP && hdr_texture && hdr_distribution && hdr_distribution->valid() && intensity > 0.0;
+	}
+};
+
+//physical sun mode with everything that only depends on the settings precomputed (sky colors with exposure and
+//intensity applied, normalized sun direction, sun color): an escaped ray costs a blend by its height and a dot
+//product with the sun instead of the whole day/sunset/night evaluation
+struct physical_sky {
+	color zenith_color = color(0.0, 0.0, 0.0);
+	color horizon_color = color(0.0, 0.0, 0.0);
+	color ground_color = color(0.0, 0.0, 0.0); //below the horizon
+	bool sun = false;
+	vec3 sun_direction = vec3(0, 1, 0);
+	double sun_cos_max = 1.0;
+	color sun_radiance = color(0.0, 0.0, 0.0); //center of the disc
+
+	physical_sky() = default;
+
+	explicit physical_sky(const EnvironmentSettings& env) {
+		//day and night parameters
+		double adjusted_height = env.sun_height() - 0.05;
+		//sun height 0.0 -> exposure 1.0,
+		//sun height -0.15 -> exposure 0.0
+		double sky_exposure = std::clamp(adjusted_height * 8.0 + 1.4, 0.0, 1.0);
+		double day_factor = std::clamp(adjusted_height * 10.0 + 1.1, 0.0, 1.0);
+		double sunset_factor = env.sunset_factor();
+		double scale = (env.intensity * 1.5) * sky_exposure;
+
+		//sky colors
+		color zenit = color(0.01, 0.03, 0.1) * (1.0 - day_factor) + color(0.2, 0.5, 1.0) * day_factor;
+		color horizon = color(0.05, 0.02, 0.01) * (1.0 - day_factor) + color(0.6, 0.8, 1.0) * day_factor;
+		//sunset horizon
+		horizon = horizon * (1.0 - sunset_factor) + color(1.0, 0.35, 0.1) * sunset_factor;
+		zenith_color = zenit * scale;
+		horizon_color = horizon * scale;
+		//darker horizon color below the horizon
+		ground_color = horizon * 0.1 * scale;
+
+		sun = env.sun_visible();
+		sun_direction = unit_vector(env.sun_direction);
+		sun_cos_max = env.sun_cos_max();
+		color s_color = env.sun_color * (1.0 - sunset_factor) + color(1.0, 0.3, 0.1) * sunset_factor;
+		double visibility = std::clamp(sun_direction.y() * 5.0 + 1.0, 0.0, 1.0);
+		sun_radiance = s_color * env.sun_intensity * visibility;
+	}
+
+	//sky gradient in unit direction dir (sun disc not included)
+	color sky(const vec3& dir) const {
+		double a = dir.y();
+		return (a > 0.0) ? (1.0 - a) * horizon_color + a * zenith_color : ground_color;
+	}
+
+	color sun_disc(const vec3& dir) const {
+		if (!sun) {
+			return color(0.0, 0.0, 0.0);
+		}
+		double sun_focus = dot(dir, sun_direction);
+		if (sun_focus <= sun_cos_max) {
+			return color(0.0, 0.0, 0.0);
+		}
+		//antyaliasing sun edges
+		return sun_radiance * smoothstep(sun_cos_max, sun_cos_max + 0.0002, sun_focus);
+	}
+
+	//sky plus the sun disc weighted by mis_weight (the MIS weight when the sun was also sampled as a light)
+	color radiance(const vec3& dir, double mis_weight = 1.0) const {
+		color result = sky(dir);
+		if (mis_weight > 0.0) {
+			result += sun_disc(dir) * mis_weight;
+		}
+		return result;
+	}
+};
+
+inline color EnvironmentSettings::sun_disc_radiance(const vec3& dir) const {
+	return physical_sky(*this).sun_disc(dir);
+}
+
+//HDR map mode with the yaw/tilt/roll rotation baked into a matrix (rows = map axes in world space) and a
+//polynomial equirect mapping: an escaped ray costs 3 dot products, fast_atan2 and fast_acos instead of
+//6 cos/sin calls and the libm atan2/acos
+struct hdr_environment {
+	shared_ptr<image_texture> texture = nullptr;
+	shared_ptr<const distribution_2d> distribution = nullptr;
+	double intensity = 1.0;
+	vec3 rows[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) }; //world -> map
+
+	hdr_environment() = default;
+
+	explicit hdr_environment(const EnvironmentSettings& env)
+		: texture(env.hdr_texture)
+		, distribution(env.hdr_distribution)
+		, intensity(env.intensity)
+	{
+		//columns of the rotation = the world axes turned into the map
+		vec3 columns[3] = {
+			env.to_map_direction(vec3(1, 0, 0)),
+			env.to_map_direction(vec3(0, 1, 0)),
+			env.to_map_direction(vec3(0, 0, 1))
+		};
+		for (int i = 0; i < 3; i++) {
+			rows[i] = vec3(columns[0][i], columns[1][i], columns[2][i]);
+		}
+	}
+
+	vec3 to_map(const vec3& dir) const {
+		return vec3(dot(rows[0], dir), dot(rows[1], dir), dot(rows[2], dir));
+	}
+
+	//inverse = transpose
+	vec3 from_map(const vec3& d) const {
+		return d.x() * rows[0] + d.y() * rows[1] + d.z() * rows[2];
+	}
+
+	//equirect coordinates of unit map direction d (u from the azimuth, v = 0 at the top)
+	static void map_uv(const vec3& d, double& u, double& v) {
+		u = (fast_atan2(d.z(), d.x()) + pi) / (2.0 * pi);
+		v = fast_acos(std::clamp<double>(d.y(), -1.0, 1.0)) / pi;
+	}
+
+	//radiance of the map seen in unit direction dir
+	color radiance(const vec3& dir) const {
+		if (!texture) {
+			return color(0.0, 0.0, 0.0);
+		}
+		double u, v;
+		map_uv(to_map(dir), u, v);
+		return texture->value(u, v, point3(0.0, 0.0, 0.0)) * intensity;
+	}
+
+	//unit direction towards the map chosen by its brightness, pdf per solid angle
+	bool sample(double u1, double u2, vec3& dir, double& pdf) const {
+		double u, v, uv_pdf;
+		if (!distribution || !distribution->sample(u1, u2, u, v, uv_pdf)) {
+			return false;
+		}
+		double theta = v * pi;
+		double phi = u * 2.0 * pi - pi;
+		double sin_theta = std::sin(theta);
+		if (sin_theta <= 0.0) {
+			return false;
+		}
+		dir = from_map(vec3(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi)));
+		pdf = uv_pdf / (2.0 * pi * pi * sin_theta);
+		return true;
+	}
+
+	//solid-angle density of sample() choosing unit direction dir
+	double pdf(const vec3& dir) const {
+		if (!distribution) {
+			return 0.0;
+		}
+		vec3 d = to_map(dir);
+		double sin_theta = std::sqrt(std::max(0.0, 1.0 - static_cast<double>(d.y()) * d.y()));
+		if (sin_theta <= 0.0) {
+			return 0.0;
+		}
+		double u, v;
+		map_uv(d, u, v);
+		return distribution->pdf(u, v) / (2.0 * pi * pi * sin_theta);
+	}
+};
+
+inline color EnvironmentSettings::hdr_radiance(const vec3& dir) const {
+	return hdr_environment(*this).radiance(dir);
+}
@@ -5,6 +5,7 @@
 //forward declaration to avoid circular dependency
 //holds information about the intersection between a ray and an object
 class material; 
+class hittable;
 
 class hit_record {
 public:
@@ -13,10 +14,11 @@ public:
 	vec3 tangent;     //tangent vector "u" at the intersection point
 	vec3 bitangent;   //bitangent vector "v" at the intersection point
 	shared_ptr<material> mat; //shared_ptr on material
+	const hittable* object = nullptr; //outermost object that reported the hit (finds the light for light sampling)
 	bool front_face = false;;  //flag for front/back face hit;
-	double t = 0.0;         //distance along the ray to the intersection point
-	double u = 0.0;        //u texture coordinate
-	double v = 0.0;        //v texture coordinate
+	real t = 0.0;           //distance along the ray to the intersection point
+	real u = 0.0;          //u texture coordinate
+	real v = 0.0;          //v texture coordinate
 
 	//sets the hit record normal vector, 'outward_normal' is assumed to have unit length
 	void set_face_normal(const ray& r, const vec3& outward_normal) {
@@ -33,4 +35,22 @@ public:
 	virtual bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const = 0;
 	//for bounding box computation to return aabb of the object
 	virtual aabb bounding_box() const = 0;
+	//coherent rays traced together (camera rays of a pixel tile), hits[k] tells if recs[k] is valid
+	//default: one ray after another, BVHs override it with packet traversal
+	virtual void hit_packet(const ray* rays, int count, interval ray_t, hit_record* recs, bool* hits) const {
+		for (int k = 0; k < count; k++) {
+			hits[k] = hit(rays[k], ray_t, recs[k]);
+		}
+	}
+
+	//light sampling (next-event estimation): point on the surface for the uniform numbers u, v with its outward normal,
+	//uv and material in rec and the density per unit area in area_pdf; false = the object can't be sampled
+	virtual bool sample_surface(double u, double v, hit_record& rec, double& area_pdf) const {
+		return false;
+	}
+
+	//density per unit area of sample_surface at point p (on the surface, normal of either side)
+	virtual double surface_pdf(const point3& p, const vec3& normal) const {
+		return 0.0;
+	}
 };
\ No newline at end of file
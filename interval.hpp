@@ -8,16 +8,16 @@
 
 class interval {
 public:
-	double min, max;
+	real min, max;
 
 	//default interval constructor is empty
 	interval()
-		: min(+std::numeric_limits<double>::infinity()) // Use std::numeric_limits to get infinity
-		, max(-std::numeric_limits<double>::infinity()) // Use std::numeric_limits to get negative infinity
+		: min(+std::numeric_limits<real>::infinity()) // Use std::numeric_limits to get infinity
+		, max(-std::numeric_limits<real>::infinity()) // Use std::numeric_limits to get negative infinity
 	{}
 
 	//parametrical constructor with interval min and max
-	interval(double min, double max) : min(min), max(max) {}
+	interval(real min, real max) : min(min), max(max) {}
 
 	//constructor combining two intervals
 	interval(const interval& a, const interval& b) {
@@ -26,23 +26,23 @@ public:
 	}
 
 	//expand interval by delta(both sides)
-	interval expand(double delta) const {
+	interval expand(real delta) const {
 		auto padding = delta / 2;
 		return interval(min - padding, max + padding);
 	}
 
 	// return size of interval
-	double size() const { 
+	real size() const { 
 		return max - min; 
 	}
 	// check if interval contains x
-	bool contains(double x) const { 
+	bool contains(real x) const { 
 		return min <= x && x <= max;
 	}
-	bool surrounds(double x) const { 
+	bool surrounds(real x) const { 
 		return min < x && max > x; 
 	}
-	double clamp(double x) const {
+	real clamp(real x) const {
 		if (x < min) {
 			return min; 
 		}
@@ -59,11 +59,11 @@ const interval interval::empty = interval(+infinity, -infinity);
 const interval interval::universe = interval(-infinity, +infinity);
 
 //interval translation by displacement
-inline interval operator+(const interval& ival, double displacement) {
+inline interval operator+(const interval& ival, real displacement) {
 	return interval(ival.min + displacement, ival.max + displacement);
 }
 
 //number + interval
-inline interval operator+(double displacement, const interval& ival) {
+inline interval operator+(real displacement, const interval& ival) {
 	return ival + displacement;
 }
\ No newline at end of file
@@ -0,0 +1,424 @@
+#pragma once
+
+#include "hittable_list.hpp"
+#include "material.hpp"
+#include "environment.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//how a shaded point chooses among the emissive objects
+enum class light_selection : int {
+	POWER = 0, //by power only (alias table, O(1)), the same choice everywhere in the scene
+	SPATIAL //light BVH: by power over distance to the shaded point, O(log N)
+};
+
+inline const char* light_selection_name(light_selection selection) {
+	switch (selection) {
+	case light_selection::SPATIAL:
+		return "Light BVH";
+	default:
+		return "Power";
+	}
+}
+
+//one light sample seen from a shaded point
+struct light_sample {
+	vec3 direction; //unit direction towards the light
+	double distance = 0.0; //to the sampled point (infinity for the environment)
+	color radiance; //emitted towards the shaded point
+	double pdf = 0.0; //solid-angle density, light selection included
+};
+
+//lights for next-event estimation: emissive top-level objects that can sample their surface (spheres, cubes and
+//instances of them) and the environment (the physical sun disc or the HDR map). A shaded point picks one light
+//(objects through the light selection, the environment gets a fixed share), traces a shadow ray to it and weights the result against BSDF sampling with the power
+//heuristic; emission found by scattered rays gets the complementary weight, so each light path is counted once
+class scene_lights {
+public:
+	constexpr static double environment_share = 0.5; //selection probability of the environment when there are emissive objects too
+
+	light_selection selection = light_selection::SPATIAL;
+
+	//collect the emissive objects of world and build both selection structures
+	//(the environment is set at render time)
+	void build(const hittable_list& world) {
+		objects.clear();
+		power_pdf.clear();
+		index_of.clear();
+		double total = 0.0;
+		for (const auto& object : world.objects) {
+			//estimated power: emitted luminance at one surface point times the area
+			hit_record rec;
+			double area_pdf = 0.0;
+			if (!object->sample_surface(0.5, 0.5, rec, area_pdf) || area_pdf <= 0.0 || !rec.mat) {
+				continue;
+			}
+			double power = rec.mat->emitted(rec.u, rec.v, rec.p).luminance() / area_pdf;
+			if (power <= 0.0) {
+				continue;
+			}
+			index_of[object.get()] = static_cast<int>(objects.size());
+			objects.push_back(object);
+			power_pdf.push_back(power);
+			total += power;
+		}
+		for (double& p : power_pdf) {
+			p /= total;
+		}
+		build_alias_table();
+		build_light_tree();
+	}
+
+	//environment used by the next render (the sun disc in physical sun mode, the map in HDR mode, nothing for solid color)
+	void set_environment(const EnvironmentSettings& env) {
+		if (env.sun_visible()) {
+			environment_light = environment_kind::SUN;
+		} else if (env.hdr_sampling()) {
+			environment_light = environment_kind::HDR;
+		} else {
+			environment_light = environment_kind::NONE;
+		}
+		sky = physical_sky(env);
+		hdr = hdr_environment(env);
+	}
+
+	bool empty() const {
+		return objects.empty() && environment_light == environment_kind::NONE;
+	}
+
+	size_t object_count() const {
+		return objects.size();
+	}
+
+	//one light sample for the point origin (light choice and point on the light, two sampler calls)
+	bool sample(const point3& origin, light_sample& ls) const {
+		double pick = sampled_double();
+		double u, v;
+		thread_sampler().get_2d(u, v);
+
+		double p_environment = environment_probability();
+		if (pick < p_environment && environment_light == environment_kind::HDR) {
+			//direction by the brightness of the map
+			double hdr_pdf = 0.0;
+			if (!hdr.sample(u, v, ls.direction, hdr_pdf)) {
+				return false;
+			}
+			ls.distance = infinity;
+			ls.radiance = hdr.radiance(ls.direction);
+			ls.pdf = p_environment * hdr_pdf;
+			return ls.pdf > 0.0;
+		}
+		if (pick < p_environment) {
+			//uniform direction in the cone of the sun disc
+			double cos_theta = 1.0 - u * (1.0 - sky.sun_cos_max);
+			double sin_theta = std::sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+			double phi = 2.0 * pi * v;
+			ls.direction = unit_vector(to_normal_frame(vec3(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta), sky.sun_direction));
+			ls.distance = infinity;
+			ls.radiance = sky.sun_disc(ls.direction);
+			ls.pdf = p_environment * sun_cone_pdf();
+			return ls.pdf > 0.0;
+		}
+		if (objects.empty()) {
+			return false;
+		}
+
+		//the rest of the pick chooses the object
+		pick = std::min((pick - p_environment) / (1.0 - p_environment), one_minus_epsilon);
+		double selection_pdf = 0.0;
+		int index = select_object(origin, pick, selection_pdf);
+		if (index < 0) {
+			return false;
+		}
+
+		hit_record rec;
+		double area_pdf = 0.0;
+		if (!objects[index]->sample_surface(u, v, rec, area_pdf) || area_pdf <= 0.0) {
+			return false;
+		}
+		vec3 to_light = rec.p - origin;
+		double distance_sq = to_light.length_squared();
+		ls.distance = std::sqrt(distance_sq);
+		if (ls.distance <= 0.0) {
+			return false;
+		}
+		ls.direction = to_light / ls.distance;
+		double cos_light = std::abs(dot(unit_vector(rec.normal), ls.direction));
+		if (cos_light <= 0.0) {
+			return false;
+		}
+		ls.radiance = rec.mat->emitted(rec.u, rec.v, rec.p);
+		ls.pdf = (1.0 - p_environment) * selection_pdf * area_pdf * distance_sq / cos_light;
+		return true;
+	}
+
+	//solid-angle density of sample() producing the direction from origin to the light surface point in rec
+	//(0 if the object isn't one of the lights)
+	double pdf(const point3& origin, const hit_record& rec) const {
+		auto it = index_of.find(rec.object);
+		if (it == index_of.end()) {
+			return 0.0;
+		}
+		vec3 to_light = rec.p - origin;
+		double distance_sq = to_light.length_squared();
+		double cos_light = std::abs(dot(unit_vector(rec.normal), unit_vector(to_light)));
+		if (cos_light <= 0.0) {
+			return 0.0;
+		}
+		double area_pdf = objects[it->second]->surface_pdf(rec.p, rec.normal);
+		return (1.0 - environment_probability()) * selection_probability(origin, it->second) * area_pdf * distance_sq / cos_light;
+	}
+
+	//solid-angle density of sample() choosing unit direction dir on the environment
+	double environment_pdf(const vec3& dir) const {
+		switch (environment_light) {
+		case environment_kind::SUN:
+			if (dot(dir, sky.sun_direction) <= sky.sun_cos_max) {
+				return 0.0;
+			}
+			return environment_probability() * sun_cone_pdf();
+		case environment_kind::HDR:
+			return environment_probability() * hdr.pdf(dir);
+		default:
+			return 0.0;
+		}
+	}
+
+	//direct light at a surface point (one light sample and a shadow ray), weighted against the material's own sampling;
+	//black for specular materials (the sample is drawn anyway, so every bounce uses the same sampler dimensions)
+	color sample_direct(const hittable& world, const ray& r_in, const hit_record& rec) const {
+		light_sample ls;
+		if (empty() || !sample(rec.p, ls) || ls.radiance.length_squared() <= 0.0) {
+			return color(0.0, 0.0, 0.0);
+		}
+		color f_cos;
+		double bsdf_pdf = 0.0;
+		if (!rec.mat->eval_scatter(r_in, rec, ls.direction, f_cos, bsdf_pdf) || f_cos.length_squared() <= 0.0) {
+			return color(0.0, 0.0, 0.0);
+		}
+
+		//shadow ray, anything in front of the sampled point blocks it
+		vec3 offset = (dot(ls.direction, rec.normal) > 0) ? (ray_epsilon * rec.normal) : (-ray_epsilon * rec.normal);
+		ray shadow(rec.p + offset, ls.direction, r_in.time());
+		hit_record blocker;
+		if (world.hit(shadow, interval(0.001, ls.distance * (1.0 - shadow_margin)), blocker)) {
+			return color(0.0, 0.0, 0.0);
+		}
+		return f_cos * ls.radiance * (power_heuristic(ls.pdf, bsdf_pdf) / ls.pdf);
+	}
+
+	//MIS weight of emission hit by a ray scattered from origin with density bsdf_pdf
+	//(bsdf_pdf 0 = specular scattering, the light couldn't be sampled there and the emission counts fully)
+	double emission_weight(const point3& origin, const hit_record& rec, double bsdf_pdf) const {
+		return (bsdf_pdf > 0.0) ? power_heuristic(bsdf_pdf, pdf(origin, rec)) : 1.0;
+	}
+
+	//MIS weight of the environment (sun disc or HDR map) seen by such a ray
+	double environment_weight(const vec3& dir, double bsdf_pdf) const {
+		return (bsdf_pdf > 0.0) ? power_heuristic(bsdf_pdf, environment_pdf(unit_vector(dir))) : 1.0;
+	}
+
+	//weight of the strategy with density a against one with density b (Veach's power heuristic, beta = 2)
+	static double power_heuristic(double a, double b) {
+		if (a <= 0.0) {
+			return 0.0;
+		}
+		if (b <= 0.0 || !std::isfinite(b)) {
+			return std::isfinite(b) ? 1.0 : 0.0;
+		}
+		double ratio = b / a;
+		return 1.0 / (1.0 + ratio * ratio);
+	}
+
+private:
+	constexpr static double shadow_margin = 1e-4; //part of the distance left out so the light itself doesn't block
+	constexpr static double one_minus_epsilon = 0x1.fffffffffffffp-1; //largest double below 1
+
+	//node of the light BVH, depth-first layout (first child = next node)
+	struct light_node {
+		point3 center; //of the bounds
+		double radius_sq = 0.0; //squared half diagonal of the bounds
+		double power = 0.0; //normalized power of the lights below
+		int second_child = -1;
+		int light = -1; //object index of a leaf, -1 for inner nodes
+	};
+
+	std::vector<shared_ptr<hittable>> objects;
+	std::vector<double> power_pdf; //normalized power of every object
+	std::unordered_map<const hittable*, int> index_of;
+
+	//Walker/Vose alias table over power_pdf
+	std::vector<double> alias_probability;
+	std::vector<int> alias;
+
+	std::vector<light_node> light_tree;
+	std::vector<uint64_t> light_trails; //per object, bit d = took the second child at depth d
+
+	enum class environment_kind {
+		NONE,
+		SUN,
+		HDR
+	};
+
+	environment_kind environment_light = environment_kind::NONE;
+	physical_sky sky; //sun disc of the physical sun mode
+	hdr_environment hdr; //map of the HDR mode
+
+	double environment_probability() const {
+		if (environment_light == environment_kind::NONE) {
+			return 0.0;
+		}
+		return objects.empty() ? 1.0 : environment_share;
+	}
+
+	double sun_cone_pdf() const {
+		double solid_angle = 2.0 * pi * (1.0 - sky.sun_cos_max);
+		return (solid_angle > 0.0) ? 1.0 / solid_angle : 0.0;
+	}
+
+	//object for the point origin from a uniform number in [0, 1), -1 if nothing can be picked
+	int select_object(const point3& origin, double pick, double& probability) const {
+		if (selection == light_selection::POWER) {
+			double scaled = pick * objects.size();
+			int index = std::min(static_cast<int>(scaled), static_cast<int>(objects.size()) - 1);
+			if (scaled - index >= alias_probability[index]) {
+				index = alias[index];
+			}
+			probability = power_pdf[index];
+			return index;
+		}
+
+		//walk down the tree, choosing a child by its importance and reusing the rest of the number
+		probability = 1.0;
+		int node = 0;
+		while (light_tree[node].light < 0) {
+			double first = importance(light_tree[node + 1], origin);
+			double second = importance(light_tree[light_tree[node].second_child], origin);
+			if (first + second <= 0.0) {
+				return -1;
+			}
+			double p_first = first / (first + second);
+			if (pick < p_first) {
+				pick = std::min(pick / p_first, one_minus_epsilon);
+				probability *= p_first;
+				node = node + 1;
+			} else {
+				pick = std::min((pick - p_first) / (1.0 - p_first), one_minus_epsilon);
+				probability *= 1.0 - p_first;
+				node = light_tree[node].second_child;
+			}
+		}
+		return light_tree[node].light;
+	}
+
+	//probability of select_object choosing object index for the point origin
+	double selection_probability(const point3& origin, int index) const {
+		if (selection == light_selection::POWER) {
+			return power_pdf[index];
+		}
+		double probability = 1.0;
+		int node = 0;
+		for (int depth = 0; light_tree[node].light < 0; depth++) {
+			double first = importance(light_tree[node + 1], origin);
+			double second = importance(light_tree[light_tree[node].second_child], origin);
+			if (first + second <= 0.0) {
+				return 0.0;
+			}
+			if ((light_trails[index] >> depth) & 1) {
+				probability *= second / (first + second);
+				node = light_tree[node].second_child;
+			} else {
+				probability *= first / (first + second);
+				node = node + 1;
+			}
+		}
+		return probability;
+	}
+
+	//estimated contribution of the lights of a node at point p: power over squared distance, the distance clamped
+	//to the node size so points inside or next to the bounds don't blow up (never 0, so no light is missed)
+	static double importance(const light_node& node, const point3& p) {
+		double distance_sq = (p - node.center).length_squared();
+		return node.power / std::max({ distance_sq, node.radius_sq, 1e-12 });
+	}
+
+	void build_alias_table() {
+		size_t count = power_pdf.size();
+		alias_probability.assign(count, 1.0);
+		alias.resize(count);
+		std::vector<double> scaled(count);
+		std::vector<int> small, large;
+		for (size_t n = 0; n < count; n++) {
+			alias[n] = static_cast<int>(n);
+			scaled[n] = power_pdf[n] * count;
+			(scaled[n] < 1.0 ? small : large).push_back(static_cast<int>(n));
+		}
+		while (!small.empty() && !large.empty()) {
+			int s = small.back();
+			small.pop_back();
+			int l = large.back();
+			alias_probability[s] = scaled[s];
+			alias[s] = l;
+			scaled[l] -= 1.0 - scaled[s];
+			if (scaled[l] < 1.0) {
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+		//the leftovers are 1 up to rounding
+	}
+
+	void build_light_tree() {
+		light_tree.clear();
+		light_trails.assign(objects.size(), 0);
+		if (objects.empty()) {
+			return;
+		}
+		std::vector<int> order(objects.size());
+		std::vector<aabb> boxes(objects.size());
+		for (size_t n = 0; n < objects.size(); n++) {
+			order[n] = static_cast<int>(n);
+			boxes[n] = objects[n]->bounding_box();
+		}
+		light_tree.reserve(2 * objects.size() - 1);
+		build_light_node(order, boxes, 0, static_cast<int>(order.size()), 0, 0);
+	}
+
+	//median split of the light centroids along the longest axis (depth stays log2 N, so the trails fit 64 bits)
+	int build_light_node(std::vector<int>& order, const std::vector<aabb>& boxes, int begin, int end, int depth, uint64_t trail) {
+		int index = static_cast<int>(light_tree.size());
+		light_tree.emplace_back();
+
+		aabb bounds = boxes[order[begin]];
+		aabb centroids(boxes[order[begin]].centroid(), boxes[order[begin]].centroid());
+		double power = 0.0;
+		for (int n = begin; n < end; n++) {
+			bounds = aabb(bounds, boxes[order[n]]);
+			point3 c = boxes[order[n]].centroid();
+			centroids = aabb(centroids, aabb(c, c));
+			power += power_pdf[order[n]];
+		}
+		vec3 half_diagonal = 0.5 * vec3(bounds.x.size(), bounds.y.size(), bounds.z.size());
+		light_tree[index].center = bounds.centroid();
+		light_tree[index].radius_sq = half_diagonal.length_squared();
+		light_tree[index].power = power;
+
+		if (end - begin == 1) {
+			light_tree[index].light = order[begin];
+			light_trails[order[begin]] = trail;
+			return index;
+		}
+		int axis = centroids.longest_axis();
+		int middle = begin + (end - begin) / 2;
+		std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+			return boxes[a].centroid()[axis] < boxes[b].centroid()[axis];
+		});
+		build_light_node(order, boxes, begin, middle, depth + 1, trail);
+		int second = build_light_node(order, boxes, middle, end, depth + 1, trail | (uint64_t(1) << depth));
+		light_tree[index].second_child = second;
+		return index;
+	}
+};
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "ray_packet.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//32-byte node of the flattened tree (two nodes per 64-byte cache line)
+struct alignas(32) linear_bvh_node {
+	float box_min[3]; //bounds rounded outwards to float
+	float box_max[3];
+	uint32_t offset = 0; //leaf: first primitive, interior: index of the second child (first child is the next node)
+	uint16_t prim_count = 0; //0 marks an interior node
+	uint8_t axis = 0; //split axis, used to visit the nearer child first
+	uint8_t pad = 0;
+
+	bool is_leaf() const {
+		return prim_count > 0;
+	}
+
+	aabb box() const {
+		return aabb(interval(box_min[0], box_max[0]), interval(box_min[1], box_max[1]), interval(box_min[2], box_max[2]));
+	}
+};
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node must stay 32 bytes");
+
+//pointer-free BVH: nodes live in one contiguous array and are traversed with an explicit stack
+class linear_bvh : public flat_bvh {
+public:
+	//build a SAH tree over the list and flatten it
+	linear_bvh(const hittable_list& list)
+		: linear_bvh(bvh_node(list)) {
+	}
+
+	//flatten an already built tree (depth-first order, left child always follows its parent)
+	linear_bvh(const bvh_node& root)
+		: bbox(root.bounding_box()) {
+		flatten(root, 0);
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		if (primitives.empty()) {
+			return false;
+		}
+		auto hit_prim = [&](uint32_t prim, interval& t) {
+			if (primitives[prim]->hit(r, t, rec)) {
+				t.max = rec.t;
+				return true;
+			}
+			return false;
+		};
+		if (global_settings::bvh_debug_mode) {
+			return traverse_debug(r, ray_t, rec, hit_prim);
+		}
+		return traverse(r, ray_t, hit_prim);
+	}
+
+	//camera ray packets share the node visits, primitives are still tested ray by ray
+	void hit_packet(const ray* rays, int count, interval ray_t, hit_record* recs, bool* hits) const override {
+		if (primitives.empty() || global_settings::bvh_debug_mode || count > ray_packet::max_size) {
+			hittable::hit_packet(rays, count, ray_t, recs, hits);
+			return;
+		}
+		ray_packet packet(rays, count, ray_t);
+		interval lane_t[ray_packet::max_size];
+		for (int k = 0; k < count; k++) {
+			lane_t[k] = ray_t;
+			hits[k] = false;
+		}
+		traverse_packet(packet, lane_t, [&](int lane, uint32_t prim, interval& t) {
+			if (primitives[prim]->hit(rays[lane], t, recs[lane])) {
+				t.max = recs[lane].t;
+				hits[lane] = true;
+				return true;
+			}
+			return false;
+		});
+	}
+
+	aabb bounding_box() const override {
+		return bbox;
+	}
+
+	size_t node_count() const override {
+		return nodes.size();
+	}
+
+	//children are stored after their parent, so a backwards sweep sees every child before its parent
+	void refit() override {
+		if (primitives.empty()) {
+			return;
+		}
+		for (size_t i = nodes.size(); i-- > 0;) {
+			linear_bvh_node& node = nodes[i];
+			aabb box;
+			if (node.is_leaf()) {
+				for (uint32_t p = 0; p < node.prim_count; p++) {
+					box = aabb(box, primitives[node.offset + p]->bounding_box());
+				}
+			} else {
+				box = aabb(nodes[i + 1].box(), nodes[node.offset].box());
+			}
+			set_box(node, box);
+		}
+		bbox = nodes[0].box();
+	}
+
+	//walks the node array front to back; hit_prim(index, ray_t) tests one primitive and shrinks ray_t.max on a hit
+	template <typename PrimHit>
+	bool traverse(const ray& r, interval& ray_t, PrimHit&& hit_prim) const {
+		if (tree_depth < stack_capacity) {
+			uint32_t stack[stack_capacity];
+			return traverse_with_stack(r, ray_t, stack, hit_prim);
+		}
+		//degenerate trees deeper than the fixed stack
+		std::vector<uint32_t> stack(tree_depth + 1);
+		return traverse_with_stack(r, ray_t, stack.data(), hit_prim);
+	}
+
+	//packet traversal: a node is visited while any lane of the packet hits it, the children are visited in the order of the first ray
+	//hit_prim(lane, index, lane_t) tests one primitive for one ray and shrinks lane_t.max on a hit
+	template <typename PacketPrimHit>
+	void traverse_packet(ray_packet& packet, interval* lane_t, PacketPrimHit&& hit_prim) const {
+		struct entry {
+			uint32_t node;
+			uint32_t mask;
+		};
+		entry fixed_stack[stack_capacity];
+		std::vector<entry> deep_stack;
+		entry* stack = fixed_stack;
+		if (tree_depth >= stack_capacity) {
+			deep_stack.resize(tree_depth + 1);
+			stack = deep_stack.data();
+		}
+
+		int stack_size = 0;
+		stack[stack_size++] = { 0, packet.all_lanes() };
+		while (stack_size > 0) {
+			entry e = stack[--stack_size];
+			const linear_bvh_node& node = nodes[e.node];
+			float t_near;
+			uint32_t mask = packet.box_hits(node.box_min, node.box_max, e.mask, t_near);
+			if (mask == 0) {
+				continue;
+			}
+
+			if (node.is_leaf()) {
+				for (int lane = 0; lane < packet.size; lane++) {
+					if (!(mask & (1u << lane))) {
+						continue;
+					}
+					for (uint32_t i = 0; i < node.prim_count; i++) {
+						if (hit_prim(lane, node.offset + i, lane_t[lane])) {
+							packet.set_t_max(lane, lane_t[lane].max);
+						}
+					}
+				}
+				continue;
+			}
+
+			//the nearer child is pushed last (popped first)
+			if (packet.first_dir_neg[node.axis]) {
+				stack[stack_size++] = { e.node + 1, mask };
+				stack[stack_size++] = { node.offset, mask };
+			} else {
+				stack[stack_size++] = { node.offset, mask };
+				stack[stack_size++] = { e.node + 1, mask };
+			}
+		}
+	}
+
+	//wireframe traversal (BVH debug mode), keeps the closest of frames and primitives
+	//hit_prim has to fill rec, frames and volumes overwrite it
+	template <typename PrimHit>
+	bool traverse_debug(const ray& r, interval ray_t, hit_record& rec, PrimHit&& hit_prim) const {
+		struct entry {
+			uint32_t node;
+			int depth;
+			int debug_depth; //depth of the enclosing node drawn as a volume (-1 = none)
+		};
+		std::vector<entry> stack;
+		stack.push_back({ 0, 0, -1 });
+
+		bool hit_anything = false;
+		int hit_debug_depth = -1;
+
+		while (!stack.empty()) {
+			entry e = stack.back();
+			stack.pop_back();
+
+			const linear_bvh_node& node = nodes[e.node];
+			aabb box = node.box();
+			interval box_t = ray_t;
+			if (!box.hit(r, box_t)) {
+				continue;
+			}
+
+			int debug_depth = e.debug_depth;
+			if (bvh_debug::is_debug_level(node.is_leaf(), e.depth)) {
+				double frame_t;
+				if (bvh_debug::hit_frame(box, r, box_t, frame_t)) {
+					bvh_debug::set_frame_hit(rec, r, frame_t, e.depth);
+					ray_t.max = frame_t;
+					hit_anything = true;
+					hit_debug_depth = -1;
+					continue;
+				}
+				debug_depth = e.depth;
+			}
+
+			if (node.is_leaf()) {
+				for (uint32_t i = 0; i < node.prim_count; i++) {
+					if (hit_prim(node.offset + i, ray_t)) {
+						hit_anything = true;
+						hit_debug_depth = debug_depth;
+					}
+				}
+			} else {
+				stack.push_back({ node.offset, e.depth + 1, debug_depth });
+				stack.push_back({ e.node + 1, e.depth + 1, debug_depth });
+			}
+		}
+
+		//volumes
+		if (hit_anything && hit_debug_depth >= 0) {
+			bvh_debug::set_volume_hit(rec, hit_debug_depth);
+		}
+		return hit_anything;
+	}
+
+private:
+	static constexpr int stack_capacity = 64;
+
+	std::vector<linear_bvh_node> nodes;
+	std::vector<const hittable*> primitives; //leaf ranges are contiguous
+	std::vector<shared_ptr<hittable>> owned; //keeps primitives alive
+	aabb bbox;
+	int tree_depth = 0;
+
+	uint32_t flatten(const bvh_node& n, int depth) {
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+		tree_depth = std::max(tree_depth, depth);
+
+		set_box(nodes[index], n.bbox);
+
+		if (n.left == nullptr) {
+			nodes[index].offset = static_cast<uint32_t>(leaf_order.size());
+			nodes[index].prim_count = static_cast<uint16_t>(n.indices.size());
+			leaf_order.insert(leaf_order.end(), n.indices.begin(), n.indices.end());
+			for (const auto& object : n.primitives) {
+				primitives.push_back(object.get());
+				owned.push_back(object);
+			}
+			return index;
+		}
+
+		nodes[index].axis = static_cast<uint8_t>(n.axis);
+		flatten(*n.left, depth + 1);
+		uint32_t second = flatten(*n.right, depth + 1);
+		nodes[index].offset = second;
+		return index;
+	}
+
+	static void set_box(linear_bvh_node& node, const aabb& box) {
+		for (int a = 0; a < 3; a++) {
+			node.box_min[a] = bvh_float::round_down(box.axis(a).min);
+			node.box_max[a] = bvh_float::round_up(box.axis(a).max);
+		}
+	}
+
+	//slab test with the ray's cached inverse direction and signs
+	static bool node_hit(const linear_bvh_node& node, const ray& r, const interval& ray_t) {
+		const point3& o = r.origin();
+		const vec3& inv = r.inv_direction();
+		double t_min = ray_t.min;
+		double t_max = ray_t.max;
+		for (int a = 0; a < 3; a++) {
+			double t0 = ((r.dir_neg[a] ? node.box_max[a] : node.box_min[a]) - o[a]) * inv[a];
+			double t1 = ((r.dir_neg[a] ? node.box_min[a] : node.box_max[a]) - o[a]) * inv[a];
+			t_min = t0 > t_min ? t0 : t_min;
+			t_max = t1 < t_max ? t1 : t_max;
+		}
+		return t_max > t_min;
+	}
+
+	template <typename PrimHit>
+	bool traverse_with_stack(const ray& r, interval& ray_t, uint32_t* stack, PrimHit& hit_prim) const {
+
+		bool hit_anything = false;
+		int stack_size = 0;
+		uint32_t current = 0;
+
+		while (true) {
+			const linear_bvh_node& node = nodes[current];
+			if (node_hit(node, r, ray_t)) {
+				if (node.is_leaf()) {
+					for (uint32_t i = 0; i < node.prim_count; i++) {
+						if (hit_prim(node.offset + i, ray_t)) {
+							hit_anything = true;
+						}
+					}
+				} else {
+					//visit the nearer child first, keep the other one for later
+					if (r.dir_neg[node.axis]) {
+						stack[stack_size++] = current + 1;
+						current = node.offset;
+					} else {
+						stack[stack_size++] = node.offset;
+						current = current + 1;
+					}
+					continue;
+				}
+			}
+			if (stack_size == 0) {
+				break;
+			}
+			current = stack[--stack_size];
+		}
+		return hit_anything;
+	}
+};
\ No newline at end of file
@@ -9,6 +9,8 @@
 //engine system
 #include "camera.hpp"
 #include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "tlas.hpp"
 #include "environment.hpp"
 #include "scene_management.hpp"
 
@@ -17,13 +19,14 @@
 #include "stb_image_write.h"
 
 //multithreading 
-#include <omp.h>
+#include "thread_pool.hpp"
 
 #include <iostream>
 #include <thread>
 #include <atomic> //for safe communication between threads
 #include <chrono>
 #include <cstdarg>
+#include <numeric>
 
 //function to create an OpenGL texture from a color buffer (used for displaying the rendered image in ImGui)
 GLuint create_texture_from_buffer(const std::vector<color>& buffer, int width, int height) {
@@ -52,7 +55,8 @@ struct AppLog {
 	std::vector<std::string> items;
 	float frame_times[90] = { 0 }; //circular buffer for frame times (last 90 frames ~ 3 seconds at 30fps)
 	int offset = 0;
-	int last_lines_count = 0;
+	long long last_samples_count = 0;
+	bvh_stats bvh_info; //metrics of the last built top-level BVH
 
 	//function to add a log entry with timestamp and formatting support (like printf)
 	void add_log(const char* fmt, ...) {
@@ -72,6 +76,19 @@ struct AppLog {
 		}
 	}
 
+	//store metrics of a freshly built BVH and report them in the log
+	void set_bvh_stats(const bvh_stats& stats) {
+		bvh_info = stats;
+		add_log("[System] BVH built in %.2f ms: %zu primitives, %d nodes, %d leaves, depth %d, SAH cost %.2f",
+			stats.build_time_ms,
+			stats.primitive_count,
+			stats.node_count,
+			stats.leaf_count,
+			stats.max_depth,
+			stats.sah_cost
+		);
+	}
+
 	//function to draw the performance metrics and logs in the ImGui window
 	void draw_tab_content(const camera& cam, bool is_rendering) {
 		//performance section tab
@@ -92,13 +109,13 @@ struct AppLog {
 
 		ImGui::Text("FPS: %.1f", fps);
 
-		//calculate how many new lines have been rendered since the last GUI update
-		int lines_this_frame = cam.lines_rendered - last_lines_count;
-		if (lines_this_frame < 0) { 
-			lines_this_frame = 0; // reset przy nowym renderze
+		//calculate how many new pixel samples have been rendered since the last GUI update
+		long long samples_this_frame = cam.samples_rendered - last_samples_count;
+		if (samples_this_frame < 0) { 
+			samples_this_frame = 0; // reset przy nowym renderze
 		} 
 
-		double rays_this_moment = static_cast<double>(cam.image_width) * lines_this_frame * cam.samples_per_pixel * cam.max_depth;
+		double rays_this_moment = static_cast<double>(samples_this_frame) * cam.max_depth;
 
 		float frame_time_sec = 1.0f / ImGui::GetIO().Framerate;
 
@@ -107,7 +124,7 @@ struct AppLog {
 			mrays_per_sec = static_cast<float>((rays_this_moment / frame_time_sec) / 1000000.0);
 		}
 
-		last_lines_count = cam.lines_rendered;
+		last_samples_count = cam.samples_rendered;
 
 		ImGui::SameLine(ImGui::GetWindowWidth() * 0.5f);
 		ImGui::Text("Throughput: %.2f Mrays/s", mrays_per_sec);
@@ -154,11 +171,8 @@ struct AppLog {
 		ImGui::Spacing();
 		ImGui::SeparatorText("System & Scene Info");
 
-		#ifdef _OPENMP
-			ImGui::BulletText("Hardware Threads: %d", omp_get_max_threads());
-		#else
-			ImGui::BulletText("Hardware Threads: 1 (OpenMP disabled)");
-		#endif
+		ImGui::BulletText("Worker Threads: %d of %d hardware threads%s", global_thread_pool().size(), thread_pool::hardware_threads(),
+			global_thread_pool().pinned() ? " (pinned to cores)" : "");
 
 		ImGui::BulletText("Render Resolution: %d x %d", cam.image_width, cam.image_height);
 
@@ -166,9 +180,38 @@ struct AppLog {
 		float mem = (cam.image_width * cam.image_height * 4.0f) / 1048576.0f;
 		ImGui::BulletText("Frame Buffer Memory: %.2f MB", mem);
 
+		//BVH quality (lower SAH cost = cheaper traversal)
+		ImGui::BulletText("BVH: %d nodes, %d leaves, depth %d (built in %.2f ms)", bvh_info.node_count, bvh_info.leaf_count, bvh_info.max_depth, bvh_info.build_time_ms);
+		ImGui::BulletText("BVH SAH Cost: %.2f (%d bins, leaf size %d)",
+			bvh_info.sah_cost,
+			global_settings::bvh_sah_bins,
+			global_settings::bvh_max_leaf_size
+		);
+		ImGui::BulletText("BVH Layout: %s (%s slab test)", bvh_layout_name(global_settings::active_bvh_layout),
+			global_settings::active_bvh_layout == bvh_layout::BINARY ? "scalar" : wide_bvh_simd_path);
+		ImGui::BulletText("Primary Rays: %.2f M rays/s per thread (%s)", cam.primary_rays_per_second * 1e-6,
+			cam.primary_packet_size > 1 ? ("packets of " + std::to_string(cam.primary_packet_size)).c_str() : "single rays");
+
+		//load balance of the last finished render (idle = waiting for the slowest thread)
+		if (!is_rendering && !cam.thread_idle_ms.empty() && cam.render_wall_ms > 0.0) {
+			double idle_max = *std::max_element(cam.thread_idle_ms.begin(), cam.thread_idle_ms.end());
+			double idle_sum = std::accumulate(cam.thread_idle_ms.begin(), cam.thread_idle_ms.end(), 0.0);
+			double utilization = 100.0 * (1.0 - idle_sum / (cam.render_wall_ms * cam.thread_idle_ms.size()));
+			ImGui::BulletText("Scheduler: %d tiles, thread idle max %.1f ms (%.0f%% utilization)", cam.render_tile_count, idle_max, utilization);
+			if (cam.adaptive_sampling) {
+				ImGui::BulletText("Adaptive Sampling: %.1f spp on average (%.0f%% of %d spp)", cam.average_samples_per_pixel,
+					100.0 * cam.average_samples_per_pixel / std::max(1, cam.samples_per_pixel), cam.samples_per_pixel);
+			}
+			if (ImGui::TreeNode("Idle Time per Thread")) {
+				for (size_t t = 0; t < cam.thread_idle_ms.size(); t++) {
+					ImGui::Text("Thread %2zu: %7.1f ms", t, cam.thread_idle_ms[t]);
+				}
+				ImGui::TreePop();
+			}
+		}
+
 		if (is_rendering) {
-			float progress = (float)cam.lines_rendered / (float)cam.image_height;
-			ImGui::ProgressBar(progress, ImVec2(-1, 0), "Rendering...");
+			ImGui::ProgressBar(cam.progress(), ImVec2(-1, 0), "Rendering...");
 		}
 	}
 };
@@ -178,9 +221,7 @@ static AppLog engine_info;
 
 int main(int argc, char* argv[]) {
 	engine_info.add_log("[Render] -Zenith Engine Started");
-	#ifdef _OPEMMP
-		engine_info.add_log("[Render] OpenMP initialized with %d threads.", omp_get_max_threads());
-	#endif //_OPEMMP
+	engine_info.add_log("[Render] Thread pool started with %d threads.", global_thread_pool().size());
 
 	// - 1. LOADING MATERIALS FROM THE LIBRARY -
 	MaterialLibrary mat_lib;
@@ -199,9 +240,12 @@ int main(int argc, char* argv[]) {
 		cam.use_fog,
 		static_cast<double>(cam.fog_density),
 		color(cam.fog_color[0], cam.fog_color[1], cam.fog_color[2])); //from scene_management.hpp
+	cam.lights.build(world); //emissive objects for light sampling
 
 	// - 5. BVH ACCELERATION STRUCTURE -
-	shared_ptr<hittable> bvh_world = make_shared<bvh_node>(world);
+	auto scene_tlas = make_shared<tlas>(world); //top level over the instances, objects keep their own BVHs
+	engine_info.set_bvh_stats(scene_tlas->stats());
+	shared_ptr<hittable> bvh_world = scene_tlas;
 
 	// - 6. CREATE ENVIRONMENT -
 	EnvironmentSettings env;
@@ -471,6 +515,47 @@ int main(int argc, char* argv[]) {
 					should_restart = true;
 				}
 
+				//progressive passes (1 spp over the whole frame at a time) with an optional time limit
+				if (ImGui::Checkbox("Progressive Refinement", &cam.progressive)) {
+					engine_info.add_log("[Config] Progressive refinement %s", cam.progressive ? "enabled" : "disabled");
+					should_restart = true;
+				}
+				if (cam.progressive) {
+					if (ImGui::InputDouble("Time Limit (s)", &cam.time_limit_seconds, 1.0, 10.0, "%.1f")) {
+						cam.time_limit_seconds = std::max(0.0, cam.time_limit_seconds);
+						should_restart = true;
+					}
+					if (ImGui::IsItemDeactivatedAfterEdit()) {
+						engine_info.add_log("[Config] Time limit set to %.1f s (0 = off)", cam.time_limit_seconds);
+					}
+				}
+
+				//adaptive sampling: converged pixels stop early, samples per pixel above is the maximum
+				if (ImGui::Checkbox("Adaptive Sampling", &cam.adaptive_sampling)) {
+					engine_info.add_log("[Config] Adaptive sampling %s", cam.adaptive_sampling ? "enabled" : "disabled");
+					if (!cam.adaptive_sampling && cam.current_display_pass == render_pass::SAMPLE_HEATMAP) {
+						cam.current_display_pass = render_pass::RGB;
+						my_post.needs_update = true;
+					}
+					should_restart = true;
+				}
+				if (cam.adaptive_sampling) {
+					ImGui::Indent();
+					if (ImGui::SliderFloat("Error Threshold", &cam.adaptive_threshold, 0.005f, 0.2f, "%.3f", ImGuiSliderFlags_Logarithmic)) {
+						should_restart = true;
+					}
+					if (ImGui::IsItemDeactivatedAfterEdit()) {
+						engine_info.add_log("[Config] Adaptive error threshold finalized at %.3f", cam.adaptive_threshold);
+					}
+					if (ImGui::SliderInt("Min Samples", &cam.adaptive_min_samples, 2, std::max(2, cam.samples_per_pixel))) {
+						should_restart = true;
+					}
+					if (ImGui::IsItemDeactivatedAfterEdit()) {
+						engine_info.add_log("[Config] Adaptive min samples finalized at %d", cam.adaptive_min_samples);
+					}
+					ImGui::Unindent();
+				}
+
 				//max depth
 				if (ImGui::SliderInt("Max Depth", &cam.max_depth, 1, 100)) {
 					should_restart = true;
@@ -478,6 +563,119 @@ int main(int argc, char* argv[]) {
 				if (ImGui::IsItemDeactivatedAfterEdit()) {
 					engine_info.add_log("[Config] Max Depth finalized at %d", cam.max_depth);
 				}
+
+				//BVH builder settings (applied on the next scene rebuild)
+				if (ImGui::SliderInt("SAH Bins", &global_settings::bvh_sah_bins, 2, 64)) {
+					should_restart = true;
+				}
+				if (ImGui::IsItemDeactivatedAfterEdit()) {
+					engine_info.add_log("[Config] BVH SAH bins finalized at %d", global_settings::bvh_sah_bins);
+				}
+				if (ImGui::SliderInt("BVH Leaf Size", &global_settings::bvh_max_leaf_size, 1, 16)) {
+					should_restart = true;
+				}
+				if (ImGui::IsItemDeactivatedAfterEdit()) {
+					engine_info.add_log("[Config] BVH max leaf size finalized at %d", global_settings::bvh_max_leaf_size);
+				}
+
+				//traversal layout (binary vs SIMD wide nodes)
+				ImGui::Text("BVH Layout:");
+				for (int n = 0; n < 3; n++) {
+					bvh_layout layout = static_cast<bvh_layout>(n);
+					if (n > 0) {
+						ImGui::SameLine();
+					}
+					if (ImGui::RadioButton(bvh_layout_name(layout), global_settings::active_bvh_layout == layout)) {
+						global_settings::active_bvh_layout = layout;
+						engine_info.add_log("[Config] BVH layout set to %s", bvh_layout_name(layout));
+						should_restart = true;
+					}
+				}
+
+				//camera rays of a pixel tile traced through the BVH together
+				ImGui::Text("Ray Packets:");
+				const int packet_sizes[] = { 1, 4, 8, 16 };
+				for (int n = 0; n < 4; n++) {
+					if (n > 0) {
+						ImGui::SameLine();
+					}
+					std::string label = (n == 0) ? "Off" : std::to_string(packet_sizes[n]);
+					if (ImGui::RadioButton(label.c_str(), cam.ray_packet_size == packet_sizes[n])) {
+						cam.ray_packet_size = packet_sizes[n];
+						engine_info.add_log("[Config] Ray packets set to %s", label.c_str());
+						should_restart = true;
+					}
+				}
+
+				//batched bounce stages instead of one path at a time
+				if (ImGui::Checkbox("Wavefront Integrator", &cam.wavefront)) {
+					engine_info.add_log("[Config] Wavefront integrator %s", cam.wavefront ? "enabled" : "disabled");
+					should_restart = true;
+				}
+
+				//next-event estimation: shadow rays to the neon lights and the sun at every diffuse hit
+				if (ImGui::Checkbox("Light Sampling (NEE)", &cam.light_sampling)) {
+					engine_info.add_log("[Config] Light sampling %s (%zu emissive objects + sun)", cam.light_sampling ? "enabled" : "disabled", cam.lights.object_count());
+					should_restart = true;
+				}
+
+				//how a shaded point picks one of the emissive objects
+				ImGui::Text("Light Selection:");
+				for (int n = 0; n < 2; n++) {
+					light_selection selection = static_cast<light_selection>(n);
+					if (n > 0) {
+						ImGui::SameLine();
+					}
+					if (ImGui::RadioButton(light_selection_name(selection), cam.lights.selection == selection)) {
+						cam.lights.selection = selection;
+						engine_info.add_log("[Config] Light selection set to %s", light_selection_name(selection));
+						should_restart = true;
+					}
+				}
+
+				//sample sequence for pixel jitter, lens and BSDF sampling
+				ImGui::Text("Sampler:");
+				for (int n = 0; n < 4; n++) {
+					sampler_type type = static_cast<sampler_type>(n);
+					if (n > 0) {
+						ImGui::SameLine();
+					}
+					if (ImGui::RadioButton(sampler_name(type), cam.sampler == type)) {
+						cam.sampler = type;
+						engine_info.add_log("[Config] Sampler set to %s", sampler_name(type));
+						should_restart = true;
+					}
+				}
+
+				//work units of the render threads (tiles from a shared queue vs one block of rows per thread)
+				ImGui::Text("Render Tiles:");
+				const int tile_sizes[] = { 0, 16, 32 };
+				for (int n = 0; n < 3; n++) {
+					if (n > 0) {
+						ImGui::SameLine();
+					}
+					std::string label = (n == 0) ? "Row Blocks" : std::to_string(tile_sizes[n]) + "x" + std::to_string(tile_sizes[n]);
+					if (ImGui::RadioButton(label.c_str(), cam.render_tile_size == tile_sizes[n])) {
+						cam.render_tile_size = tile_sizes[n];
+						engine_info.add_log("[Config] Render tiles set to %s", label.c_str());
+						should_restart = true;
+					}
+				}
+
+				//size of the shared worker pool, fewer threads leave cores free on shared hosts
+				if (ImGui::SliderInt("Worker Threads", &global_settings::worker_threads, 0, thread_pool::hardware_threads(),
+					global_settings::worker_threads == 0 ? "All" : "%d")) {
+					should_restart = true;
+				}
+				if (ImGui::IsItemDeactivatedAfterEdit()) {
+					engine_info.add_log("[Config] Worker threads finalized at %d (0 = all)", global_settings::worker_threads);
+				}
+				if (thread_pool::pinning_supported()) {
+					if (ImGui::Checkbox("Pin Threads to Cores", &global_settings::pin_worker_threads)) {
+						engine_info.add_log("[Config] Thread pinning %s", global_settings::pin_worker_threads ? "enabled" : "disabled");
+						should_restart = true;
+					}
+				}
 				
 				ImGui::SeparatorText("Render Passes");
 				//dropdown passes
@@ -485,7 +683,7 @@ int main(int argc, char* argv[]) {
 
 				//reference to static array of pass names in camera class
 				if (ImGui::BeginCombo("##SelectPass", camera::pass_names[static_cast<int>(cam.current_display_pass)])) {
-					for (int n = 0; n < 7; n++) {
+					for (int n = 0; n < 8; n++) {
 						render_pass p = static_cast<render_pass>(n);
 
 						//display only if checkbox for the pass is active (except RGB always active)
@@ -502,6 +700,8 @@ int main(int argc, char* argv[]) {
 							is_enabled = cam.use_refraction;
 						} else if (p == render_pass::Z_DEPTH) {
 							is_enabled = cam.use_z_depth_buffer;
+						} else if (p == render_pass::SAMPLE_HEATMAP) {
+							is_enabled = cam.adaptive_sampling;
 						}
 						if (!is_enabled && p != render_pass::RGB) {
 							continue;
@@ -1303,7 +1503,7 @@ int main(int argc, char* argv[]) {
 				ImGui::SeparatorText("Export Output");
 
 				//block buttons at the beginning and during rendering
-				bool disable_export = !is_rendering && (cam.lines_rendered > 0);
+				bool disable_export = !is_rendering && (cam.samples_rendered > 0);
 
 				if (!disable_export) {
 					ImGui::BeginDisabled();
@@ -1326,7 +1526,7 @@ int main(int argc, char* argv[]) {
 				//option to save all passes at once
 				if (ImGui::Button("Save All Passes", ImVec2(-1, 0))) {
 					int saved_count = 0;
-					for (int n = 0; n < 7; n++) {
+					for (int n = 0; n < 8; n++) {
 						render_pass p = static_cast<render_pass>(n);
 
 						bool is_enabled = (p == render_pass::RGB); //RGB always enabled
@@ -1342,6 +1542,8 @@ int main(int argc, char* argv[]) {
 							is_enabled = cam.use_refraction;
 						} else if (p == render_pass::Z_DEPTH) {
 							is_enabled = cam.use_z_depth_buffer;
+						} else if (p == render_pass::SAMPLE_HEATMAP) {
+							is_enabled = cam.adaptive_sampling;
 						}
 
 						if (is_enabled) {
@@ -1395,9 +1597,11 @@ int main(int argc, char* argv[]) {
 		//render control & progress
 		ImGui::Separator();
 		if (is_active_session) {
-			//progress bar
-			float progress = (float)cam.lines_rendered / (float)cam.image_height;
-			ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f));
+			//progress bar in samples per pixel (finished passes of the whole frame)
+			float progress = cam.progress();
+			char progress_text[32];
+			snprintf(progress_text, sizeof(progress_text), "%d / %d spp", cam.current_samples_count.load(), cam.samples_per_pixel);
+			ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), progress_text);
 			static int last_logged_percent = -1;
 			int current_percent = static_cast<int>(progress * 100.0f);
 
@@ -1450,7 +1654,7 @@ int main(int argc, char* argv[]) {
 					auto render_end_time = std::chrono::steady_clock::now();
 					std::chrono::duration<float> elapsed = render_end_time - render_start_time;
 					last_render_duration = elapsed.count();
-					last_progress_percent = ((float)cam.lines_rendered / (float)cam.image_height) * 100.0f;
+					last_progress_percent = cam.progress() * 100.0f;
 					render_was_cancelled = true;
 
 					is_rendering = false; //stop the thread
@@ -1472,7 +1676,7 @@ int main(int argc, char* argv[]) {
 				render_start_time = std::chrono::steady_clock::now(); //start the timer for the new render
 				last_render_duration = 0.0f; //reset last render duration for display purposes
 				render_was_cancelled = false;
-				cam.lines_rendered = 0;
+				cam.samples_rendered = 0;
 				is_active_session = true;
 				should_restart = true; //launch central restart system below
 
@@ -1489,6 +1693,9 @@ int main(int argc, char* argv[]) {
 				render_thread.join();
 			}
 
+			//the pool is idle here (render thread joined), apply a new thread count or pinning
+			global_thread_pool().configure(global_settings::worker_threads, global_settings::pin_worker_threads);
+
 			hittable_list world = build_geometry(
 				mat_lib,
 				assets,
@@ -1497,11 +1704,16 @@ int main(int argc, char* argv[]) {
 				color(cam.fog_color[0], cam.fog_color[1], cam.fog_color[2])
 			);
 
-			bvh_world = make_shared<bvh_node>(world);
+			auto scene_tlas = make_shared<tlas>(world);
+			bvh_world = scene_tlas;
+			cam.lights.build(world);
 
 			//update BVH for a new geometry(fog included)
 			if (!ImGui::IsAnyItemActive()) {
 				engine_info.add_log("[System] Scene geometry rebuilt. BVH acceleration structure updated.");
+				engine_info.set_bvh_stats(scene_tlas->stats());
+			} else {
+				engine_info.bvh_info = scene_tlas->stats();
 			}
 			
 			//reset accumulator and sample count 
@@ -1520,8 +1732,8 @@ int main(int argc, char* argv[]) {
 			render_thread = std::thread([&is_rendering, &cam, bvh_world, env, my_post, &last_render_duration, render_start_time]() {
 				cam.render(*bvh_world, env, my_post, is_rendering);
 
-				//finalize - only if render finished without interrupts
-				if (is_rendering.load() && cam.lines_rendered >= cam.image_height) {
+				//finalize - only if render finished without interrupts (all samples or the time limit)
+				if (is_rendering.load()) {
 					auto render_end_time = std::chrono::steady_clock::now();
 					std::chrono::duration<float> elapsed = render_end_time - render_start_time;
 					last_render_duration = elapsed.count();
@@ -1555,6 +1767,11 @@ int main(int argc, char* argv[]) {
 			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_preview_update).count();
 			bool time_to_update = (elapsed > 150); // 150ms = 10 FPS
 
+			//every finished pass is shown (and feeds the auto-exposure statistics) right away
+			static int last_preview_samples = -1;
+			int preview_samples = cam.current_samples_count.load();
+			bool new_pass = (preview_samples != last_preview_samples);
+
 			static bool last_bvh_flag = false;
 
 			if (my_post.debug.bvh != last_bvh_flag) {
@@ -1566,7 +1783,8 @@ int main(int argc, char* argv[]) {
 				engine_info.add_log("[System] BVH Mode changed: Accumulators cleared.");
 			}
 
-			if (just_finished || (rendering_active && time_to_update) || my_post.needs_update) {
+			if (just_finished || (rendering_active && (time_to_update || new_pass)) || my_post.needs_update) {
+				last_preview_samples = preview_samples;
 				//lock the size(thread-safe mindset)
 				int locked_w = cam.image_width;
 				int locked_h = cam.image_height;
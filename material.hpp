@@ -2,6 +2,7 @@
 
 #include "hittable.hpp"
 #include "texture.hpp"
+#include "sampler.hpp"
 
 //abstract class material
 class material {
@@ -25,6 +26,12 @@ public:
 		const ray& r_in, const hit_record& rec, 
 		color& attenuation, ray& scattered) const = 0;
 
+	//light sampling (next-event estimation): BSDF times cosine for light arriving from unit direction and the density
+	//of scatter() choosing that direction; false = specular scattering (mirror, glass), no light sampling there
+	virtual bool eval_scatter(const ray& r_in, const hit_record& rec, const vec3& direction, color& f_cos, double& pdf) const {
+		return false;
+	}
+
 	//denoising function
 	virtual color get_albedo(const hit_record& rec) const {
 		return color(0, 0, 0); //default black
@@ -79,12 +86,8 @@ public:
 			working_normal = get_bumped_normal(rec, my_bump_texture, bump_strength);
 		}
 
-		auto scatter_direction = working_normal + random_unit_vector();
-
-		//catch degenerate scatter direction
-		if (scatter_direction.near_zero()) {
-			scatter_direction = working_normal;
-		}
+		//importance sampling: cosine-weighted direction around the normal (pdf cos/pi cancels the lambert term)
+		vec3 scatter_direction = sampled_cosine_direction(working_normal);
 		//adjust hit point by a small epsilon to avoid self-intersection
 		point3 origin_adjusted = rec.p + (rec.normal * ray_epsilon);
 
@@ -95,6 +98,20 @@ public:
 		return true;
 	}
 
+	//albedo / pi * cos, the density of the cosine-weighted scatter is cos / pi
+	bool eval_scatter(const ray& r_in, const hit_record& rec, const vec3& direction, color& f_cos, double& pdf) const override {
+		vec3 working_normal = my_bump_texture ? get_bumped_normal(rec, my_bump_texture, bump_strength) : rec.normal;
+		double cos_theta = dot(working_normal, direction);
+		if (cos_theta <= 0.0) {
+			f_cos = color(0, 0, 0);
+			pdf = 0.0;
+			return true;
+		}
+		pdf = cos_theta / pi;
+		f_cos = tex->value(rec.u, rec.v, rec.p) * pdf;
+		return true;
+	}
+
 	//overwrite OIDN function
 	color get_albedo(const hit_record& rec) const override {
 		//return raw texture color in hit point
@@ -138,7 +155,7 @@ public:
 		vec3 reflected = reflect(v, working_normal);
 
 		//adding fuzziness to the reflection
-		vec3 scattered_direction = unit_vector(reflected + (fuzz * random_unit_vector()));
+		vec3 scattered_direction = unit_vector(reflected + (fuzz * sampled_unit_vector()));
 
 		//moving the ray origin a bit off the surface to prevent self-intersection (shadow acne)
 		point3 shadow_orig = rec.p + (ray_epsilon * rec.normal);
@@ -208,7 +225,7 @@ public:
 		vec3 direction;
 
 		//direction of the angle of incidence
-		if (cannot_refract || reflectance(cos_theta, ri) > random_double()) {
+		if (cannot_refract || reflectance(cos_theta, ri) > sampled_double()) {
 			direction = reflect(unit_direction, working_normal);
 		} else {
 			direction = refract(unit_direction, working_normal, ri);
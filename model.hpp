@@ -1,23 +1,38 @@
 #pragma once
 
 #include "tiny_obj_loader.h"
-#include "hittable_list.hpp"
-#include "bvh.hpp"
-#include "triangle.hpp"
+#include "triangle_mesh.hpp"
 
 #include <iostream>
 
-class model : public hittable {
+//mesh loaded from an .obj file, centered at (0,0,0) with its bottom at y=0
+class model : public triangle_mesh {
 public:
-	model(const std::string& filename, shared_ptr<material> mat, double scale = 1.0) {
+	model(const std::string& filename, shared_ptr<material> mat, double scale = 1.0)
+		: triangle_mesh(load_obj(filename, scale), mat)
+	{
+		//debug infos
+		std::cout << "Model: " << filename << " loaded (" << triangle_count() << " triangles, "
+			<< memory_bytes() / 1024 << " KB of vertex/index data)." << std::endl;
+		std::cout << "Model: " << filename << " BVH built in " << stats().build_time_ms << " ms" << std::endl;
+
+		aabb final_box = bounding_box();
+		std::cout << "Model: " << filename << " centered at (0,0,0)\n";
+		std::cout << "New Min: " << final_box.x.min << ", " << final_box.y.min << "\n";
+	}
+
+private:
+	//copies the tinyobj buffers as they are (positions moved and scaled), faces keep their per-corner indices
+	static mesh_data load_obj(const std::string& filename, double scale) {
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		std::string warn, err;
+		mesh_data data;
 
 		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str())) {
 			std::cerr << "Cannot load the model: " << warn << err << std::endl;
-			return;
+			return data;
 		}
 
 		//calculate center of the model  
@@ -41,80 +56,29 @@ public:
 			(min_z + max_z) / 2.0
 		);
 
-		hittable_list triangles;
-
-		//get_v(lambda)
-		auto get_v = [&](tinyobj::index_t idx) {
-			return point3(
-				(attrib.vertices[3 * idx.vertex_index + 0] - center_offset.x()) * scale,
-				(attrib.vertices[3 * idx.vertex_index + 1] - center_offset.y()) * scale,
-				(attrib.vertices[3 * idx.vertex_index + 2] - center_offset.z()) * scale
-			);
-		};
+		data.positions.reserve(attrib.vertices.size() / 3);
+		for (size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+			data.positions.push_back(point3(
+				(attrib.vertices[i + 0] - center_offset.x()) * scale,
+				(attrib.vertices[i + 1] - center_offset.y()) * scale,
+				(attrib.vertices[i + 2] - center_offset.z()) * scale
+			));
+		}
+		data.normals.reserve(attrib.normals.size() / 3);
+		for (size_t i = 0; i + 2 < attrib.normals.size(); i += 3) {
+			data.normals.push_back(vec3(attrib.normals[i + 0], attrib.normals[i + 1], attrib.normals[i + 2]));
+		}
+		data.uvs.reserve(attrib.texcoords.size() / 2);
+		for (size_t i = 0; i + 1 < attrib.texcoords.size(); i += 2) {
+			data.uvs.push_back(triangle_uv{ attrib.texcoords[i + 0], attrib.texcoords[i + 1] });
+		}
 
-		//create triangles from loaded model using offset and scale
+		//faces (LoadObj triangulates, so every face has 3 corners)
 		for (const auto& shape : shapes) {
-			size_t index_offset = 0;
-			for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-				// Assume the model is made of triangles
-				tinyobj::index_t idx0 = shape.mesh.indices[index_offset + 0];
-				tinyobj::index_t idx1 = shape.mesh.indices[index_offset + 1];
-				tinyobj::index_t idx2 = shape.mesh.indices[index_offset + 2];
-
-				//get vertex function with offset and scale applied
-				point3 v0 = get_v(idx0);
-				point3 v1 = get_v(idx1);
-				point3 v2 = get_v(idx2);
-
-				//get normals
-				vec3 n0, n1, n2;
-				if (idx0.normal_index >= 0) {
-					n0 = vec3(attrib.normals[3 * idx0.normal_index + 0],
-						attrib.normals[3 * idx0.normal_index + 1],
-						attrib.normals[3 * idx0.normal_index + 2]);
-					n1 = vec3(attrib.normals[3 * idx1.normal_index + 0],
-						attrib.normals[3 * idx1.normal_index + 1],
-						attrib.normals[3 * idx1.normal_index + 2]);
-					n2 = vec3(attrib.normals[3 * idx2.normal_index + 0],
-						attrib.normals[3 * idx2.normal_index + 1],
-						attrib.normals[3 * idx2.normal_index + 2]);
-				} else {
-					//if no normals, calculate face normal for flat shading
-					vec3 flat_normal = unit_vector(cross(v1 - v0, v2 - v0));
-					n0 = n1 = n2 = flat_normal;
-				}
-
-				//all 7 parameters triangle constructor
-				triangles.add(make_shared<triangle>(v0, v1, v2, n0, n1, n2, mat));
-
-				index_offset += 3;
+			for (const auto& idx : shape.mesh.indices) {
+				data.corners.push_back(mesh_corner{ idx.vertex_index, idx.normal_index, idx.texcoord_index });
 			}
 		}
-
-		//BVH only for this model
-		mesh_bvh = make_shared<bvh_node>(triangles);
-
-		//debug infos
-		std::cout << "Model: " << filename << " loaded (" << triangles.objects.size() << " triangles)." << std::endl;
-
-		aabb final_box = mesh_bvh->bounding_box();
-		std::cout << "Model: " << filename << " centered at (0,0,0)\n";
-		std::cout << "New Min: " << final_box.x.min << ", " << final_box.y.min << "\n";
-	}
-
-	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
-		return mesh_bvh->hit(r, ray_t, rec);
-	}
-
-	aabb bounding_box() const override {
-		return mesh_bvh->bounding_box();
+		return data;
 	}
-
-	void set_material(std::shared_ptr<material> m) {
-		mat = m;
-	}
-
-private:
-	shared_ptr<bvh_node> mesh_bvh;
-	shared_ptr<material> mat;
-};
+};
\ No newline at end of file
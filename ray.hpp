@@ -2,11 +2,22 @@
 
 #include "vec3.hpp"
 
+#include <utility>
+
 class ray {
 public:
 	point3 orig;
 	vec3 dir;
-	double tm = 0.0;
+	real tm = 0.0;
+
+	//cached for the slab tests (BVH nodes, cubes), computed once in the constructors
+	vec3 inv_dir;
+	int dir_neg[3] = { 0, 0, 0 }; //1 when the direction component is negative
+
+	//cached for the watertight triangle test: axes permuted so that kz is the dominant direction axis,
+	//and the shear that maps the direction onto +z (Sx, Sy, Sz)
+	int shear_axis[3] = { 0, 1, 2 };
+	vec3 shear;
 
 	//default constructor
 	ray() {}
@@ -14,14 +25,18 @@ public:
 	//2 args 
 	ray(const point3& origin, const vec3& direction)
 		: orig(origin), dir(direction), tm(0.0) // tm set to 0.0
-	{}
+	{
+		cache_inverse();
+	}
 
 	// 3 args parametric constructor, creates the object with initial values
-	ray(const point3& origin, const vec3& direction, double time)
+	ray(const point3& origin, const vec3& direction, real time)
 		: orig(origin)
 		, dir(direction)
 		, tm(time)
-	{}
+	{
+		cache_inverse();
+	}
 
 	//getters
 	const point3& origin() const {
@@ -30,12 +45,35 @@ public:
 	const vec3& direction() const {
 		return dir;
 	}
-	double time() const {
+	real time() const {
 		return tm;
 	}
+	const vec3& inv_direction() const {
+		return inv_dir;
+	}
 
 	//return the point at radius for parameter t
-	point3 at(double t) const {
+	point3 at(real t) const {
 		return orig + t * dir;
 	}
+
+private:
+	void cache_inverse() {
+		inv_dir = vec3(1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z());
+		dir_neg[0] = inv_dir.x() < 0.0;
+		dir_neg[1] = inv_dir.y() < 0.0;
+		dir_neg[2] = inv_dir.z() < 0.0;
+
+		real ax = std::fabs(dir.x()), ay = std::fabs(dir.y()), az = std::fabs(dir.z());
+		int kz = (ax > ay) ? ((ax > az) ? 0 : 2) : ((ay > az) ? 1 : 2);
+		int kx = (kz + 1) % 3;
+		int ky = (kx + 1) % 3;
+		if (dir[kz] < 0.0) {
+			std::swap(kx, ky); //keeps the winding of the projected triangle
+		}
+		shear_axis[0] = kx;
+		shear_axis[1] = ky;
+		shear_axis[2] = kz;
+		shear = vec3(dir[kx] * inv_dir[kz], dir[ky] * inv_dir[kz], inv_dir[kz]);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "bvh.hpp"
+
+#include <cstdint>
+
+//up to 16 coherent rays (camera rays of a pixel tile) in SoA form, traversed through a BVH together:
+//every node box is tested against all lanes at once (4 lanes per SSE instruction)
+struct ray_packet {
+	static constexpr int max_size = 16;
+
+	//origins nudged like wide_bvh_ray, the min planes are measured from lo_origin and the max planes from hi_origin,
+	//which enlarges the box slightly for either direction sign (covers the double -> float rounding)
+	alignas(16) float lo_origin[3][max_size];
+	alignas(16) float hi_origin[3][max_size];
+	alignas(16) float inv_dir[3][max_size];
+	alignas(16) float t_min[max_size];
+	alignas(16) float t_max[max_size];
+	int size = 0;
+	int first_dir_neg[3] = { 0, 0, 0 }; //direction signs of the first ray, orders the children of binary nodes
+
+	ray_packet(const ray* rays, int count, const interval& ray_t)
+		: size(count) {
+		for (int l = 0; l < max_size; l++) {
+			if (l >= count) {
+				//padding lanes never hit anything
+				for (int a = 0; a < 3; a++) {
+					lo_origin[a][l] = hi_origin[a][l] = inv_dir[a][l] = 0.0f;
+				}
+				t_min[l] = std::numeric_limits<float>::infinity();
+				t_max[l] = -std::numeric_limits<float>::infinity();
+				continue;
+			}
+			const point3& o = rays[l].origin();
+			double max_abs = std::max({ std::abs(o.x()), std::abs(o.y()), std::abs(o.z()) });
+			float eps = static_cast<float>(max_abs * 0x1p-22);
+			for (int a = 0; a < 3; a++) {
+				lo_origin[a][l] = static_cast<float>(o[a]) + eps;
+				hi_origin[a][l] = static_cast<float>(o[a]) - eps;
+				inv_dir[a][l] = static_cast<float>(rays[l].inv_direction()[a]);
+			}
+			t_min[l] = bvh_float::round_down(ray_t.min);
+			set_t_max(l, ray_t.max);
+		}
+		for (int a = 0; a < 3; a++) {
+			first_dir_neg[a] = (count > 0) ? rays[0].dir_neg[a] : 0;
+		}
+	}
+
+	uint32_t all_lanes() const {
+		return (size >= 32) ? 0xFFFFFFFFu : ((1u << size) - 1u);
+	}
+
+	//float rounding of the distances (pbrt-style 1 + 2 * gamma(3) bound, as in the wide nodes)
+	void set_t_max(int lane, double t) {
+		t_max[lane] = bvh_float::round_up(t) * (1.0f + 0x1p-21f);
+	}
+
+	//lanes of mask whose ray passes through the box, t_near gets the closest entry distance of those lanes
+	uint32_t box_hits(const float box_min[3], const float box_max[3], uint32_t mask, float& t_near) const {
+		uint32_t hits = 0;
+		t_near = std::numeric_limits<float>::infinity();
+#if defined(ZENITH_WIDE_BVH_SSE)
+		for (int base = 0; base < size; base += 4) {
+			if (((mask >> base) & 0xF) == 0) {
+				continue;
+			}
+			__m128 tn = _mm_load_ps(t_min + base);
+			__m128 tf = _mm_load_ps(t_max + base);
+			for (int a = 0; a < 3; a++) {
+				__m128 inv = _mm_load_ps(inv_dir[a] + base);
+				__m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box_min[a]), _mm_load_ps(lo_origin[a] + base)), inv);
+				__m128 tb = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box_max[a]), _mm_load_ps(hi_origin[a] + base)), inv);
+				//NaN (0 * inf on a plane through the origin) keeps the previous value
+				tn = _mm_max_ps(_mm_min_ps(ta, tb), tn);
+				tf = _mm_min_ps(_mm_max_ps(ta, tb), tf);
+			}
+			uint32_t group = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tn, tf))) & ((mask >> base) & 0xF);
+			if (group != 0) {
+				alignas(16) float near_lanes[4];
+				_mm_store_ps(near_lanes, tn);
+				for (int i = 0; i < 4; i++) {
+					if ((group & (1u << i)) && near_lanes[i] < t_near) {
+						t_near = near_lanes[i];
+					}
+				}
+				hits |= group << base;
+			}
+		}
+#else
+		for (int l = 0; l < size; l++) {
+			if (!(mask & (1u << l))) {
+				continue;
+			}
+			float tn = t_min[l];
+			float tf = t_max[l];
+			for (int a = 0; a < 3; a++) {
+				float ta = (box_min[a] - lo_origin[a][l]) * inv_dir[a][l];
+				float tb = (box_max[a] - hi_origin[a][l]) * inv_dir[a][l];
+				float lo = ta < tb ? ta : tb;
+				float hi = ta < tb ? tb : ta;
+				tn = lo > tn ? lo : tn;
+				tf = hi < tf ? hi : tf;
+			}
+			if (tn <= tf) {
+				hits |= 1u << l;
+				t_near = tn < t_near ? tn : t_near;
+			}
+		}
+#endif
+		return hits;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+//PCG32 random number generator (O'Neill, pcg-random.org): 16 bytes of state, one multiply per number
+class pcg32 {
+public:
+	pcg32(uint64_t seed_state = 0x853c49e6748fea9bULL, uint64_t seed_stream = 0xda3e39cb94b95bdbULL) {
+		seed(seed_state, seed_stream);
+	}
+
+	//restart the generator, different streams give independent sequences for the same state
+	void seed(uint64_t seed_state, uint64_t seed_stream) {
+		state = 0;
+		inc = (seed_stream << 1u) | 1u;
+		next_uint();
+		state += seed_state;
+		next_uint();
+	}
+
+	uint32_t next_uint() {
+		uint64_t old_state = state;
+		state = old_state * 6364136223846793005ULL + inc;
+		uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+		uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+	}
+
+	//uniform double in [0,1)
+	double next_double() {
+		return next_uint() * (1.0 / 4294967296.0);
+	}
+
+private:
+	uint64_t state;
+	uint64_t inc;
+};
+
+//splitmix64 finalizer, spreads neighbouring pixel/sample indices over the whole seed range
+inline uint64_t mix_seed(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+//generator of the calling thread (no shared state between render threads),
+//seeded from std::random_device until the renderer reseeds it for a pixel sample
+inline pcg32& thread_rng() {
+	thread_local pcg32 rng(std::random_device{}(), std::random_device{}());
+	return rng;
+}
+
+//deterministic sequence for one sample of one pixel in one frame: the image doesn't depend on
+//which thread renders a pixel or in which order, so renders are reproducible for any thread count
+inline void seed_thread_rng(uint64_t pixel, uint64_t sample, uint64_t frame, uint64_t stream = 0) {
+	thread_rng().seed(mix_seed(pixel ^ mix_seed(sample ^ mix_seed(frame))), stream);
+}
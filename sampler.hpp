@@ -0,0 +1,316 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//sample sequence for camera jitter, lens and BSDF sampling
+enum class sampler_type : int {
+	RANDOM = 0, //independent uniform numbers (PCG32)
+	STRATIFIED, //jittered strata over the samples of a pixel, shuffled per pixel and dimension
+	SOBOL, //Owen-scrambled Sobol (0,2)-sequence, padded per dimension pair
+	BLUE_NOISE //the same Sobol points in every pixel, shifted per pixel by a blue-noise mask
+};
+
+inline const char* sampler_name(sampler_type type) {
+	switch (type) {
+	case sampler_type::STRATIFIED:
+		return "Stratified";
+	case sampler_type::SOBOL:
+		return "Sobol";
+	case sampler_type::BLUE_NOISE:
+		return "Blue Noise";
+	default:
+		return "Random";
+	}
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+	x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+	x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+	x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+	return x;
+}
+
+//hash-based Owen scrambling (Burley 2020): every bit is flipped depending on the bits above it only,
+//so the (0,2)-sequence stays stratified while each seed gives an independent randomization
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverse_bits(x);
+}
+
+//first two dimensions of the Sobol sequence (van der Corput and its Sobol partner), 32-bit fixed point
+inline uint32_t sobol_dim0(uint32_t index) {
+	return reverse_bits(index);
+}
+
+inline uint32_t sobol_dim1(uint32_t index) {
+	uint32_t result = 0;
+	for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+		if (index & 1u) {
+			result ^= v;
+		}
+	}
+	return result;
+}
+
+//random permutation of [0, count) chosen by seed (Kensler, "Correlated Multi-Jittered Sampling")
+inline uint32_t permute_index(uint32_t i, uint32_t count, uint32_t seed) {
+	uint32_t w = count - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do {
+		i ^= seed;
+		i *= 0xe170893du;
+		i ^= seed >> 16;
+		i ^= (i & w) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3fu;
+		i ^= seed >> 23;
+		i ^= (i & w) >> 1;
+		i *= 1u | seed >> 27;
+		i *= 0x6935fa69u;
+		i ^= (i & w) >> 11;
+		i *= 0x74dcb303u;
+		i ^= (i & w) >> 2;
+		i *= 0x9e501cc3u;
+		i ^= (i & w) >> 2;
+		i *= 0xc860a3dfu;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= count);
+	return (i + seed) % count;
+}
+
+//64x64 tileable blue-noise threshold mask (values in [0,1)), built once with void-and-cluster (Ulichney 1993)
+class blue_noise_mask {
+public:
+	static constexpr int size = 64;
+
+	static const blue_noise_mask& get() {
+		static const blue_noise_mask mask;
+		return mask;
+	}
+
+	double value(int x, int y) const {
+		return values[(y & (size - 1)) * size + (x & (size - 1))];
+	}
+
+private:
+	std::vector<double> values;
+
+	blue_noise_mask() {
+		const int n = size * size;
+		const double sigma = 1.5;
+
+		//toroidal gaussian splat of one point, energy[p] = sum of the splats of all set points
+		std::vector<double> kernel(n);
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				int dx = std::min(x, size - x);
+				int dy = std::min(y, size - y);
+				kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+			}
+		}
+		std::vector<unsigned char> pattern(n, 0);
+		std::vector<double> energy(n, 0.0);
+		auto splat = [&](int p, double sign) {
+			int px = p % size;
+			int py = p / size;
+			for (int y = 0; y < size; y++) {
+				for (int x = 0; x < size; x++) {
+					energy[y * size + x] += sign * kernel[((y - py) & (size - 1)) * size + ((x - px) & (size - 1))];
+				}
+			}
+		};
+		//tightest cluster = set point with the most energy, largest void = empty point with the least
+		auto extreme = [&](unsigned char set, bool largest) {
+			int best = -1;
+			for (int p = 0; p < n; p++) {
+				if (pattern[p] == set && (best < 0 || (largest ? energy[p] > energy[best] : energy[p] < energy[best]))) {
+					best = p;
+				}
+			}
+			return best;
+		};
+
+		//initial pattern: 10% of the points at fixed pseudo-random positions, relaxed until stable
+		pcg32 rng(0x626c7565ULL, 1);
+		int initial = n / 10;
+		for (int placed = 0; placed < initial;) {
+			int p = static_cast<int>(rng.next_uint() % n);
+			if (!pattern[p]) {
+				pattern[p] = 1;
+				splat(p, 1.0);
+				placed++;
+			}
+		}
+		for (int iteration = 0; iteration < n; iteration++) {
+			int cluster = extreme(1, true);
+			pattern[cluster] = 0;
+			splat(cluster, -1.0);
+			int void_p = extreme(0, false);
+			pattern[void_p] = 1;
+			splat(void_p, 1.0);
+			if (void_p == cluster) {
+				break;
+			}
+		}
+
+		//ranks: remove clusters from the initial pattern (ranks below it), then fill voids (ranks above it)
+		std::vector<int> rank(n, 0);
+		std::vector<unsigned char> initial_pattern = pattern;
+		std::vector<double> initial_energy = energy;
+		for (int r = initial - 1; r >= 0; r--) {
+			int cluster = extreme(1, true);
+			pattern[cluster] = 0;
+			splat(cluster, -1.0);
+			rank[cluster] = r;
+		}
+		pattern = initial_pattern;
+		energy = initial_energy;
+		for (int r = initial; r < n; r++) {
+			int void_p = extreme(0, false);
+			pattern[void_p] = 1;
+			splat(void_p, 1.0);
+			rank[void_p] = r;
+		}
+
+		values.resize(n);
+		for (int p = 0; p < n; p++) {
+			values[p] = (rank[p] + 0.5) / n;
+		}
+	}
+};
+
+//sample values of the current pixel sample: every call takes the next dimension, so the same dimension
+//always feeds the same decision along a path (camera jitter, lens, then BSDF and russian roulette per bounce)
+class pixel_sampler {
+public:
+	//start a pixel sample, first_dimension > 0 continues a sample whose earlier dimensions were used elsewhere
+	void start(sampler_type sampler, int x, int y, uint32_t sample, uint32_t sample_count, uint64_t frame, uint32_t first_dimension = 0) {
+		type = sampler;
+		pixel_x = x;
+		pixel_y = y;
+		sample_index = sample;
+		samples = std::max(1u, sample_count);
+		dimension = first_dimension;
+		pixel_seed = static_cast<uint32_t>(mix_seed((static_cast<uint64_t>(y) << 32 | static_cast<uint32_t>(x)) ^ mix_seed(frame)));
+	}
+
+	double get_1d() {
+		double u, v;
+		get_2d(u, v);
+		return u;
+	}
+
+	void get_2d(double& u, double& v) {
+		uint32_t dim = dimension;
+		dimension += 2;
+		switch (type) {
+		case sampler_type::STRATIFIED: {
+			//sqrt(n) x sqrt(n) strata, samples past the grid fall back to random numbers
+			uint32_t grid = static_cast<uint32_t>(std::sqrt(static_cast<double>(samples)));
+			uint32_t cells = grid * grid;
+			if (sample_index < cells) {
+				uint32_t cell = permute_index(sample_index, cells, dimension_seed(dim));
+				u = (cell % grid + thread_rng().next_double()) / grid;
+				v = (cell / grid + thread_rng().next_double()) / grid;
+				return;
+			}
+			break;
+		}
+		case sampler_type::SOBOL: {
+			//the sample order is shuffled per pixel and dimension pair, so the pairs stay uncorrelated
+			uint32_t seed = dimension_seed(dim);
+			uint32_t index = owen_scramble(sample_index, seed);
+			u = to_unit(owen_scramble(sobol_dim0(index), hash32(seed ^ 0x5bd1e995u)));
+			v = to_unit(owen_scramble(sobol_dim1(index), hash32(seed ^ 0x27d4eb2du)));
+			return;
+		}
+		case sampler_type::BLUE_NOISE: {
+			//Cranley-Patterson rotation by the mask (offset per dimension), the error looks like blue noise on screen
+			uint32_t seed = static_cast<uint32_t>(mix_seed(dim));
+			uint32_t index = owen_scramble(sample_index, seed);
+			const blue_noise_mask& mask = blue_noise_mask::get();
+			int ox = static_cast<int>(seed & 63u);
+			int oy = static_cast<int>((seed >> 6) & 63u);
+			u = wrap(to_unit(sobol_dim0(index)) + mask.value(pixel_x + ox, pixel_y + oy));
+			v = wrap(to_unit(sobol_dim1(index)) + mask.value(pixel_x + oy + 17, pixel_y + ox + 31));
+			return;
+		}
+		default:
+			break;
+		}
+		u = thread_rng().next_double();
+		v = thread_rng().next_double();
+	}
+
+private:
+	sampler_type type = sampler_type::RANDOM;
+	int pixel_x = 0;
+	int pixel_y = 0;
+	uint32_t pixel_seed = 0;
+	uint32_t sample_index = 0;
+	uint32_t samples = 1;
+	uint32_t dimension = 0;
+
+	static uint32_t hash32(uint32_t x) {
+		return static_cast<uint32_t>(mix_seed(x));
+	}
+
+	uint32_t dimension_seed(uint32_t dim) const {
+		return hash32(pixel_seed ^ (dim * 0x9e3779b9u));
+	}
+
+	static double to_unit(uint32_t x) {
+		return x * (1.0 / 4294967296.0);
+	}
+
+	static double wrap(double x) {
+		return (x >= 1.0) ? x - 1.0 : x;
+	}
+};
+
+//sampler of the calling thread, started by the camera for every pixel sample
+inline pixel_sampler& thread_sampler() {
+	thread_local pixel_sampler sampler;
+	return sampler;
+}
+
+//point on the unit sphere from the next two sampler dimensions
+inline vec3 sampled_unit_vector() {
+	double u, v;
+	thread_sampler().get_2d(u, v);
+	return unit_vector_from_uniform(u, v);
+}
+
+//point in the unit disk from the next two sampler dimensions (concentric mapping keeps the strata)
+inline vec3 sampled_in_unit_disk() {
+	double u, v;
+	thread_sampler().get_2d(u, v);
+	return unit_disk_from_uniform(u, v);
+}
+
+//cosine-weighted direction around unit normal n from the next two sampler dimensions
+inline vec3 sampled_cosine_direction(const vec3& n) {
+	double u, v;
+	thread_sampler().get_2d(u, v);
+	return to_normal_frame(cosine_hemisphere_from_uniform(u, v), n);
+}
+
+//uniform number in [0,1) from the next sampler dimension
+inline double sampled_double() {
+	return thread_sampler().get_1d();
+}
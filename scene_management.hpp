@@ -13,6 +13,7 @@
 #include "constant_medium.hpp" //fog
 
 //transformation and instances
+#include "transform_instance.hpp"
 #include "material_instance.hpp"
 #include "translate.hpp"
 #include "rotate_x.hpp"
@@ -110,28 +111,23 @@ hittable_list build_geometry(MaterialLibrary& mat_lib, const sceneAssetsLoader&
 
 	// - 2. FREE STANDING GEOMETRIES (in the middle)
 	//
-	//teapot (loaded object .obj from the file)
-	auto teapot_inst = make_shared<material_instance>(assets.teapot, mat_lib.get("glass"));
-	auto rot_teapot_x = make_shared<rotate_x>(teapot_inst, -90.0);
-	auto rot_teapot_y = make_shared<rotate_y>(rot_teapot_x, 30.0);
-	auto teapot_final = make_shared<translate>(rot_teapot_y, point3(0.0, 1.0, -2.5));
-	world.add(teapot_final);
+	//teapot (loaded object .obj from the file, its mesh BVH is shared by the instance)
+	auto teapot_transform = affine_transform::translation(vec3(0.0, 1.0, -2.5))
+		* affine_transform::rotation_y(30.0)
+		* affine_transform::rotation_x(-90.0);
+	world.add(make_shared<transform_instance>(assets.teapot, teapot_transform, mat_lib.get("glass")));
 
 	//sphere
 	auto big_sphere_geom = make_shared<sphere>(point3(0.0, 0.0, 0.0), 1.0, nullptr);
-	auto big_sphere_instance = make_shared<material_instance>(big_sphere_geom, mat_lib.get("scratched_mirror"));
-	world.add(make_shared<translate>(big_sphere_instance, point3(0.0, 1.0, 0.0)));
+	world.add(make_shared<transform_instance>(big_sphere_geom, affine_transform::translation(vec3(0.0, 1.0, 0.0)), mat_lib.get("scratched_mirror")));
 	//small sphere #1
 	auto small_sphere_geom = make_shared<sphere>(point3(0.0, 0.0, 0.0), 0.5, nullptr);
-	auto small_sphere_instance = make_shared<material_instance>(small_sphere_geom, mat_lib.get("scratched_gold_mat"));
-	world.add(make_shared<translate>(small_sphere_instance, point3(3.0, 0.5, -1.0)));
+	world.add(make_shared<transform_instance>(small_sphere_geom, affine_transform::translation(vec3(3.0, 0.5, -1.0)), mat_lib.get("scratched_gold_mat")));
 	//small sphere #2
-	auto small_bubble_instance = make_shared<material_instance>(small_sphere_geom, mat_lib.get("wood_bumpy_texture"));
-	world.add(make_shared<translate>(small_bubble_instance, point3(3.0, 0.5, 1.0)));
+	world.add(make_shared<transform_instance>(small_sphere_geom, affine_transform::translation(vec3(3.0, 0.5, 1.0)), mat_lib.get("wood_bumpy_texture")));
 	//cube
 	auto big_cube_geom = make_shared<cube>(point3(0.0, 0.0, 0.0), nullptr);
-	auto big_cube_instance = make_shared<material_instance>(big_cube_geom, mat_lib.get("foggy_glass"));
-	world.add(make_shared<translate>(big_cube_instance, point3(0.0, 1.0, 2.5)));
+	world.add(make_shared<transform_instance>(big_cube_geom, affine_transform::translation(vec3(0.0, 1.0, 2.5)), mat_lib.get("foggy_glass")));
 
 	// - 3. RANDOM SPREADED GEOMETRIES
 	//
@@ -187,18 +183,15 @@ hittable_list build_geometry(MaterialLibrary& mat_lib, const sceneAssetsLoader&
 				//2. get material
 				auto obj_mat = mat_lib.get(selected_mat_name);
 
-				//3. scale
-				auto scaled_obj = make_shared<scale>(geometry, scale_v);
-				//4. rotation (only cubes)
-				shared_ptr<hittable> rotated_obj = scaled_obj;
+				//3. scale, rotation (only cubes) and final position in one matrix
+				affine_transform object_to_world = affine_transform::translation(center);
 				if (geometry == master_cube) {
-					rotated_obj = make_shared<rotate_y>(scaled_obj, random_double(0.0, 90.0));
+					object_to_world = object_to_world * affine_transform::rotation_y(random_double(0.0, 90.0));
 				}
+				object_to_world = object_to_world * affine_transform::scaling(scale_v);
 
-				//5. applying material to the instance through material_instance class
-				auto instance = make_shared<material_instance>(rotated_obj, obj_mat);
-				//3. final position translation
-				world.add(make_shared<translate>(instance, center));
+				//4. one instance of the shared prefab with its own material
+				world.add(make_shared<transform_instance>(geometry, object_to_world, obj_mat));
 			}
 		}
 	}
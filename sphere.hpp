@@ -16,12 +16,16 @@ public:
 
 	//sphere
 	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
-		vec3 oc = center - r.origin();
-		//ray-sphere intersection logic
-		auto a = r.direction().length_squared();
-		auto h = dot(r.direction(), oc);
-		auto c = oc.length_squared() - radius * radius;
-		auto discriminant = h * h - a * c;
+		//ray-sphere intersection logic, always solved in double: with a float vec3 the ground sphere
+		//(radius 1000) would lose the hit point to cancellation in c = |oc|^2 - r^2
+		double ocx = static_cast<double>(center.x()) - r.origin().x();
+		double ocy = static_cast<double>(center.y()) - r.origin().y();
+		double ocz = static_cast<double>(center.z()) - r.origin().z();
+		double dx = r.direction().x(), dy = r.direction().y(), dz = r.direction().z();
+		double a = dx * dx + dy * dy + dz * dz;
+		double h = dx * ocx + dy * ocy + dz * ocz;
+		double c = ocx * ocx + ocy * ocy + ocz * ocz - radius * radius;
+		double discriminant = h * h - a * c;
 
 		//check if radius hits the sphere
 		if (discriminant < 0) {
@@ -59,15 +63,34 @@ public:
 		rec.bitangent = cross(rec.normal, rec.tangent);
 
 		rec.mat = mat;
+		rec.object = this;
 
 		return true;
 	}
+
+	//uniform point on the whole sphere (the half facing away is occluded by the sphere itself)
+	bool sample_surface(double u, double v, hit_record& rec, double& area_pdf) const override {
+		if (radius <= 0.0) {
+			return false;
+		}
+		vec3 n = unit_vector_from_uniform(u, v);
+		rec.p = center + radius * n;
+		rec.normal = n;
+		get_sphere_uv(n, rec.u, rec.v);
+		rec.mat = mat;
+		area_pdf = 1.0 / (4.0 * pi * radius * radius);
+		return true;
+	}
+
+	double surface_pdf(const point3& p, const vec3& normal) const override {
+		return (radius > 0.0) ? 1.0 / (4.0 * pi * radius * radius) : 0.0;
+	}
 	
 	aabb bounding_box() const override {
 		return bbox;
 	}
 
-	static void get_sphere_uv(const point3& p, double& u, double& v) {
+	static void get_sphere_uv(const point3& p, real& u, real& v) {
 		//p: a given point on the sphere of radius one, centered at the origin
 		//u: returned value [0,1] of angle around the Y axis from X=-1
 		//v: returned value [0,1] of angle from Y=-1 to Y=+1
@@ -77,6 +77,14 @@ public:
 		return color(0.0, 0.0, 0.0);
 	}
 
+	int get_width() const {
+		return width;
+	}
+
+	int get_height() const {
+		return height;
+	}
+
 private:
 	float* data_f = nullptr;
 	unsigned char* data_u = nullptr;
@@ -0,0 +1,276 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+//persistent worker threads shared by rendering, post-processing, denoiser input and BVH builds
+//created once, a loop only wakes them up (no thread creation per render or per restart)
+//the calling thread works on the loop too, so a pool of n threads has n - 1 workers
+class thread_pool {
+public:
+	explicit thread_pool(int thread_count = 0, bool pin = false) {
+		start(thread_count, pin);
+	}
+
+	~thread_pool() {
+		stop();
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	//threads working on a loop (workers + caller)
+	int size() const {
+		return static_cast<int>(workers.size()) + 1;
+	}
+
+	bool pinned() const {
+		return pin_threads;
+	}
+
+	//pinning is only implemented where the OS has an affinity call for single threads
+	static bool pinning_supported() {
+#if defined(_WIN32) || defined(__linux__)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static int hardware_threads() {
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	//recreates the workers if the count (0 = all hardware threads) or pinning changed, never call it during a loop
+	void configure(int thread_count, bool pin) {
+		if (resolve(thread_count) == size() && pin == pin_threads) {
+			return;
+		}
+		stop();
+		start(thread_count, pin);
+	}
+
+	//body(i) for every i in [0, count), indices are handed out dynamically in chunks of grain (0 = automatic)
+	//waits while another thread runs a loop on the pool, runs serially when called from inside a loop
+	template <typename F>
+	void parallel_for(int count, F&& body, int grain = 0) {
+		if (inside_loop()) {
+			run_serial(count, body);
+			return;
+		}
+		std::unique_lock<std::mutex> submit(submit_mutex);
+		run(count, body, grain);
+	}
+
+	//same, but runs serially on the caller instead of waiting when the pool is busy
+	//(GUI previews while a render occupies the pool)
+	template <typename F>
+	void parallel_for_if_idle(int count, F&& body, int grain = 0) {
+		if (inside_loop()) {
+			run_serial(count, body);
+			return;
+		}
+		std::unique_lock<std::mutex> submit(submit_mutex, std::try_to_lock);
+		if (!submit.owns_lock()) {
+			run_serial(count, body);
+			return;
+		}
+		run(count, body, grain);
+	}
+
+private:
+	//one parallel loop, workers take chunks of [0, count) from next
+	struct loop_job {
+		std::function<void(int, int)> range; //body over [begin, end)
+		int count = 0;
+		int grain = 1;
+		std::atomic<int> next{ 0 };
+	};
+
+	std::vector<std::thread> workers;
+	bool pin_threads = false;
+
+	std::mutex submit_mutex; //one loop at a time
+	std::mutex state_mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	loop_job* current = nullptr;
+	uint64_t generation = 0; //incremented for every loop, workers compare it with the last one they ran
+	int pending = 0; //workers that did not finish the current loop yet
+	bool quit = false;
+
+	static int resolve(int thread_count) {
+		return (thread_count > 0) ? std::min(thread_count, 4 * hardware_threads()) : hardware_threads();
+	}
+
+	//true on pool workers and on a caller while it works on a loop (nested loops run serially)
+	static bool& inside_loop() {
+		thread_local bool inside = false;
+		return inside;
+	}
+
+	template <typename F>
+	static void run_serial(int count, F& body) {
+		for (int i = 0; i < count; i++) {
+			body(i);
+		}
+	}
+
+	//the caller counts as inside the loop from here on, also when it runs the loop alone
+	template <typename F>
+	void run(int count, F& body, int grain) {
+		inside_loop() = true;
+		run_parallel(count, body, grain);
+		inside_loop() = false;
+	}
+
+	template <typename F>
+	void run_parallel(int count, F& body, int grain) {
+		if (count <= 0) {
+			return;
+		}
+		if (workers.empty() || count == 1 || grain >= count) {
+			run_serial(count, body);
+			return;
+		}
+
+		loop_job job;
+		job.range = [&body](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				body(i);
+			}
+		};
+		job.count = count;
+		job.grain = (grain > 0) ? grain : std::max(1, count / (8 * size())); //~8 chunks per thread
+
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			current = &job;
+			pending = static_cast<int>(workers.size());
+			generation++;
+		}
+		work_ready.notify_all();
+
+		work_on(job);
+
+		std::unique_lock<std::mutex> lock(state_mutex);
+		work_done.wait(lock, [&] { return pending == 0; });
+		current = nullptr;
+	}
+
+	static void work_on(loop_job& job) {
+		for (;;) {
+			int begin = job.next.fetch_add(job.grain);
+			if (begin >= job.count) {
+				return;
+			}
+			job.range(begin, std::min(begin + job.grain, job.count));
+		}
+	}
+
+	//seen = generation when the worker was started (the pool is idle then), only later loops wake it up
+	void worker_loop(uint64_t seen) {
+		inside_loop() = true;
+		for (;;) {
+			loop_job* job = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(state_mutex);
+				work_ready.wait(lock, [&] { return quit || generation != seen; });
+				if (quit) {
+					return;
+				}
+				seen = generation;
+				job = current;
+			}
+			work_on(*job);
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				if (--pending == 0) {
+					work_done.notify_one();
+				}
+			}
+		}
+	}
+
+	void start(int thread_count, bool pin) {
+		int count = resolve(thread_count);
+		pin_threads = pin && pinning_supported();
+		quit = false;
+		for (int i = 0; i < count - 1; i++) {
+			workers.emplace_back(&thread_pool::worker_loop, this, generation);
+			if (pin_threads) {
+				//worker i on core i + 1, core 0 is left to the calling thread (render/GUI)
+				pin_to_core(workers.back(), (i + 1) % hardware_threads());
+			}
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			quit = true;
+		}
+		work_ready.notify_all();
+		for (auto& worker : workers) {
+			if (worker.joinable()) {
+				worker.join();
+			}
+		}
+		workers.clear();
+	}
+
+	static void pin_to_core(std::thread& t, int core) {
+#if defined(_WIN32)
+		if (core < 64) {
+			SetThreadAffinityMask(static_cast<HANDLE>(t.native_handle()), DWORD_PTR(1) << core);
+		}
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(t.native_handle(), sizeof(cpu_set_t), &set);
+#else
+		(void)t;
+		(void)core;
+#endif
+	}
+};
+
+//the engine's pool, created on first use with the global settings
+inline thread_pool& global_thread_pool() {
+	static thread_pool pool(global_settings::worker_threads, global_settings::pin_worker_threads);
+	return pool;
+}
+
+//loop on the shared pool, or a plain loop on the caller when parallel is false (small inputs)
+template <typename F>
+inline void parallel_for(int count, F&& body, bool parallel = true, int grain = 0) {
+	if (!parallel) {
+		for (int i = 0; i < count; i++) {
+			body(i);
+		}
+		return;
+	}
+	global_thread_pool().parallel_for(count, std::forward<F>(body), grain);
+}
\ No newline at end of file
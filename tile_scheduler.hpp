@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+//rectangle of pixels rendered by one thread as a unit of work
+struct render_tile {
+	int x0, y0; //upper left pixel
+	int x1, y1; //one past the lower right pixel
+
+	int pixel_count() const {
+		return (x1 - x0) * (y1 - y0);
+	}
+};
+
+//position of point d on the Hilbert curve filling an n x n grid (n a power of two)
+inline void hilbert_to_xy(int n, int d, int& x, int& y) {
+	x = 0;
+	y = 0;
+	for (int s = 1; s < n; s *= 2) {
+		int rx = 1 & (d / 2);
+		int ry = 1 & (d ^ rx);
+		//rotate the quadrant
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+}
+
+//dynamic work distribution: the image is cut into square tiles in Hilbert order (neighbouring tiles
+//follow each other, so the scene data they touch stays in cache) and every thread takes the next
+//free tile from an atomic counter until none are left, so threads on cheap regions (sky) help with the rest
+//tile_size 0 = one fixed block of rows per thread (the old static split, kept for comparison)
+class tile_scheduler {
+public:
+	tile_scheduler(int width, int height, int tile_size, int num_threads)
+		: static_split(tile_size <= 0)
+		, static_taken(num_threads, 0) {
+		if (static_split) {
+			//contiguous row blocks, thread t takes block t
+			int rows_per_thread = height / num_threads;
+			int extra = height % num_threads;
+			int start = 0;
+			for (int t = 0; t < num_threads; t++) {
+				int end = start + rows_per_thread + (t < extra ? 1 : 0);
+				tiles.push_back(render_tile{ 0, start, width, end });
+				start = end;
+			}
+			return;
+		}
+
+		int tiles_x = (width + tile_size - 1) / tile_size;
+		int tiles_y = (height + tile_size - 1) / tile_size;
+		int n = 1;
+		while (n < std::max(tiles_x, tiles_y)) {
+			n *= 2;
+		}
+
+		//walk the curve over the power of two grid, skipping tiles outside the image
+		for (int d = 0; d < n * n; d++) {
+			int tx, ty;
+			hilbert_to_xy(n, d, tx, ty);
+			if (tx >= tiles_x || ty >= tiles_y) {
+				continue;
+			}
+			int x0 = tx * tile_size;
+			int y0 = ty * tile_size;
+			tiles.push_back(render_tile{ x0, y0, std::min(x0 + tile_size, width), std::min(y0 + tile_size, height) });
+		}
+	}
+
+	//hands out the next tile to a thread, false when there is nothing left for it
+	bool next(int thread, render_tile& tile) {
+		if (static_split) {
+			if (static_taken[thread]) {
+				return false;
+			}
+			static_taken[thread] = 1; //only written by this thread
+			tile = tiles[thread];
+			return true;
+		}
+		int index = next_tile.fetch_add(1);
+		if (index >= static_cast<int>(tiles.size())) {
+			return false;
+		}
+		tile = tiles[index];
+		return true;
+	}
+
+	int tile_count() const {
+		return static_cast<int>(tiles.size());
+	}
+
+private:
+	bool static_split;
+	std::vector<char> static_taken;
+	std::vector<render_tile> tiles;
+	std::atomic<int> next_tile{ 0 };
+};
\ No newline at end of file
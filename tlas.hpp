@@ -0,0 +1,74 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "hittable_list.hpp"
+#include "transform_instance.hpp"
+
+#include <chrono>
+
+//two-level scene structure
+//bottom level: shared objects with their own BVHs (mesh BVHs, prefab spheres/cubes), built once
+//top level: a BVH over the instance bounds only, refitted when instances move and rebuilt on demand
+class tlas : public hittable {
+public:
+	tlas(const hittable_list& world)
+		: objects(world.objects) {
+		rebuild();
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		return accelerator->hit(r, ray_t, rec, depth, debug_wire);
+	}
+
+	void hit_packet(const ray* rays, int count, interval ray_t, hit_record* recs, bool* hits) const override {
+		accelerator->hit_packet(rays, count, ray_t, recs, hits);
+	}
+
+	aabb bounding_box() const override {
+		return accelerator->bounding_box();
+	}
+
+	//full SAH build of the top level (after objects were added/removed or many instances moved far)
+	void rebuild() {
+		bvh_node root(objects, 0, objects.size());
+		build_stats = root.stats();
+		accelerator = make_bvh_accelerator(root);
+	}
+
+	//moves one top-level instance and refits the top level (no rebuild), false if the object is not an instance
+	bool set_instance_transform(size_t index, const affine_transform& object_to_world) {
+		auto instance = (index < objects.size()) ? std::dynamic_pointer_cast<transform_instance>(objects[index]) : nullptr;
+		if (instance == nullptr) {
+			return false;
+		}
+		instance->set_transform(object_to_world);
+		refit();
+		return true;
+	}
+
+	void refit() {
+		auto start = std::chrono::steady_clock::now();
+		accelerator->refit();
+		last_refit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//metrics of the last full build
+	const bvh_stats& stats() const {
+		return build_stats;
+	}
+
+	double refit_time_ms() const {
+		return last_refit_ms;
+	}
+
+	size_t object_count() const {
+		return objects.size();
+	}
+
+private:
+	std::vector<shared_ptr<hittable>> objects; //instances and other top-level objects (e.g. fog volume)
+	shared_ptr<flat_bvh> accelerator;
+	bvh_stats build_stats;
+	double last_refit_ms = 0.0;
+};
\ No newline at end of file
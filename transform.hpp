@@ -0,0 +1,157 @@
+#pragma once
+
+#include "common.hpp"
+#include "aabb.hpp"
+
+#include <cmath>
+
+//3x4 affine matrix: 3x3 linear part (rotation, scale) + translation column, the last row is implicitly (0, 0, 0, 1)
+class affine_transform {
+public:
+	double m[3][4];
+
+	//identity
+	affine_transform() {
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				m[r][c] = (r == c) ? 1.0 : 0.0;
+			}
+		}
+	}
+
+	static affine_transform translation(const vec3& offset) {
+		affine_transform t;
+		t.m[0][3] = offset.x();
+		t.m[1][3] = offset.y();
+		t.m[2][3] = offset.z();
+		return t;
+	}
+
+	static affine_transform scaling(const vec3& factors) {
+		affine_transform t;
+		t.m[0][0] = factors.x();
+		t.m[1][1] = factors.y();
+		t.m[2][2] = factors.z();
+		return t;
+	}
+
+	//counter-clockwise rotations (right-handed) around the main axes
+	static affine_transform rotation_x(double degrees) {
+		double s = std::sin(degrees_to_radians(degrees));
+		double c = std::cos(degrees_to_radians(degrees));
+		affine_transform t;
+		t.m[1][1] = c; t.m[1][2] = -s;
+		t.m[2][1] = s; t.m[2][2] = c;
+		return t;
+	}
+
+	static affine_transform rotation_y(double degrees) {
+		double s = std::sin(degrees_to_radians(degrees));
+		double c = std::cos(degrees_to_radians(degrees));
+		affine_transform t;
+		t.m[0][0] = c; t.m[0][2] = s;
+		t.m[2][0] = -s; t.m[2][2] = c;
+		return t;
+	}
+
+	static affine_transform rotation_z(double degrees) {
+		double s = std::sin(degrees_to_radians(degrees));
+		double c = std::cos(degrees_to_radians(degrees));
+		affine_transform t;
+		t.m[0][0] = c; t.m[0][1] = -s;
+		t.m[1][0] = s; t.m[1][1] = c;
+		return t;
+	}
+
+	//composition, b is applied first: (a * b)(p) = a(b(p))
+	affine_transform operator*(const affine_transform& b) const {
+		affine_transform t;
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				t.m[r][c] = m[r][0] * b.m[0][c] + m[r][1] * b.m[1][c] + m[r][2] * b.m[2][c] + ((c == 3) ? m[r][3] : 0.0);
+			}
+		}
+		return t;
+	}
+
+	point3 transform_point(const point3& p) const {
+		return point3(
+			m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+			m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+			m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]
+		);
+	}
+
+	//directions ignore the translation
+	vec3 transform_vector(const vec3& v) const {
+		return vec3(
+			m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+			m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+			m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z()
+		);
+	}
+
+	//multiplies by the transposed 3x3 part, called on the world -> object matrix this is the normal matrix
+	vec3 transform_transposed(const vec3& v) const {
+		return vec3(
+			m[0][0] * v.x() + m[1][0] * v.y() + m[2][0] * v.z(),
+			m[0][1] * v.x() + m[1][1] * v.y() + m[2][1] * v.z(),
+			m[0][2] * v.x() + m[1][2] * v.y() + m[2][2] * v.z()
+		);
+	}
+
+	//determinant of the 3x3 part
+	double determinant() const {
+		return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+			+ m[0][1] * (m[1][2] * m[2][0] - m[1][0] * m[2][2])
+			+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	}
+
+	//inverse of the 3x3 part by cofactors, translation follows as -inverse * t (identity for singular matrices)
+	affine_transform inverse() const {
+		double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+		double det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+
+		affine_transform inv;
+		if (std::abs(det) < 1e-300) {
+			return inv;
+		}
+		double inv_det = 1.0 / det;
+
+		inv.m[0][0] = c00 * inv_det;
+		inv.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+		inv.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+		inv.m[1][0] = c01 * inv_det;
+		inv.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+		inv.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+		inv.m[2][0] = c02 * inv_det;
+		inv.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+		inv.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+		vec3 t = inv.transform_vector(vec3(m[0][3], m[1][3], m[2][3]));
+		inv.m[0][3] = -t.x();
+		inv.m[1][3] = -t.y();
+		inv.m[2][3] = -t.z();
+		return inv;
+	}
+
+	//tight box around the transformed box (Arvo: per row, add the smaller/larger of min and max products)
+	aabb transform_box(const aabb& box) const {
+		if (box.x.min > box.x.max || box.y.min > box.y.max || box.z.min > box.z.max) {
+			return box; //empty stays empty
+		}
+		double lo[3], hi[3];
+		for (int r = 0; r < 3; r++) {
+			lo[r] = hi[r] = m[r][3];
+			for (int c = 0; c < 3; c++) {
+				double a = m[r][c] * box.axis(c).min;
+				double b = m[r][c] * box.axis(c).max;
+				lo[r] += std::fmin(a, b);
+				hi[r] += std::fmax(a, b);
+			}
+		}
+		return aabb(interval(lo[0], hi[0]), interval(lo[1], hi[1]), interval(lo[2], hi[2]));
+	}
+};
\ No newline at end of file
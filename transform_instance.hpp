@@ -0,0 +1,129 @@
+#pragma once
+
+#include "hittable.hpp"
+#include "material.hpp"
+#include "transform.hpp"
+
+//instance of a shared object (sphere, cube, mesh with its own BVH) placed with an affine transform
+//the object is never copied, every instance only stores its matrices, bounds and an optional material
+//wrapping another instance folds both into one node (translate/rotate_*/scale/material_instance chains
+//end up as a single matrix and a single virtual hit call)
+class transform_instance : public hittable {
+public:
+	transform_instance(shared_ptr<hittable> object, const affine_transform& object_to_world,
+		shared_ptr<material> material_override = nullptr)
+		: object(object)
+		, material_override(material_override)
+	{
+		affine_transform full_transform = object_to_world;
+		if (auto inner = std::dynamic_pointer_cast<transform_instance>(object)) {
+			//inner transform is applied first, the outer material wins (as it did with nested wrappers)
+			this->object = inner->object;
+			full_transform = object_to_world * inner->object_to_world;
+			if (this->material_override == nullptr) {
+				this->material_override = inner->material_override;
+			}
+		}
+		set_transform(full_transform);
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		//world -> object, the direction is not normalized so t stays the same in both spaces
+		ray local_r(
+			world_to_object.transform_point(r.origin()),
+			world_to_object.transform_vector(r.direction()),
+			r.time()
+		);
+
+		if (!object->hit(local_r, ray_t, rec)) {
+			return false;
+		}
+
+		//object -> world, normals use the inverse transpose (front_face is preserved by the transform)
+		rec.p = object_to_world.transform_point(rec.p);
+		rec.normal = unit_vector(world_to_object.transform_transposed(rec.normal));
+		rec.tangent = transform_direction(rec.tangent);
+		rec.bitangent = transform_direction(rec.bitangent);
+
+		if (material_override != nullptr) {
+			rec.mat = material_override;
+		} else if (rec.mat == nullptr) {
+			//bare prefabs have no material, assign a bright error material
+			static auto error_mat = make_shared<lambertian>(color(1, 0, 1));
+			rec.mat = error_mat;
+		}
+		rec.object = this;
+		return true;
+	}
+
+	//point sampled on the object and moved to world space, the area density is divided by the area scale
+	//of the transform at that point (|det M| * |M^-T n| for a unit object-space normal n)
+	bool sample_surface(double u, double v, hit_record& rec, double& area_pdf) const override {
+		double local_pdf = 0.0;
+		if (!object->sample_surface(u, v, rec, local_pdf)) {
+			return false;
+		}
+		vec3 local_normal = unit_vector(rec.normal);
+		vec3 normal = world_to_object.transform_transposed(local_normal);
+		double area_scale = linear_det * normal.length();
+		if (area_scale <= 0.0) {
+			return false;
+		}
+		rec.p = object_to_world.transform_point(rec.p);
+		rec.normal = unit_vector(normal);
+		if (material_override != nullptr) {
+			rec.mat = material_override;
+		}
+		area_pdf = local_pdf / area_scale;
+		return true;
+	}
+
+	double surface_pdf(const point3& p, const vec3& normal) const override {
+		//object-space normal from the world normal (M^T n), then the same area scale as sample_surface
+		vec3 local_normal = object_to_world.transform_transposed(normal);
+		if (local_normal.length_squared() <= 0.0) {
+			return 0.0;
+		}
+		local_normal = unit_vector(local_normal);
+		double area_scale = linear_det * world_to_object.transform_transposed(local_normal).length();
+		if (area_scale <= 0.0) {
+			return 0.0;
+		}
+		return object->surface_pdf(world_to_object.transform_point(p), local_normal) / area_scale;
+	}
+
+	aabb bounding_box() const override {
+		return bbox;
+	}
+
+	//moves the instance (full object -> world matrix), the owner has to refit or rebuild the BVH above it
+	void set_transform(const affine_transform& new_object_to_world) {
+		object_to_world = new_object_to_world;
+		world_to_object = object_to_world.inverse();
+		linear_det = std::abs(object_to_world.determinant());
+		bbox = object_to_world.transform_box(object->bounding_box());
+	}
+
+	const affine_transform& transform() const {
+		return object_to_world;
+	}
+
+	void set_material(shared_ptr<material> m) {
+		material_override = m;
+	}
+
+private:
+	shared_ptr<hittable> object;
+	shared_ptr<material> material_override;
+	affine_transform object_to_world;
+	affine_transform world_to_object;
+	double linear_det = 1.0; //|det| of the 3x3 part (volume scale)
+	aabb bbox;
+
+	//unit direction in world space (tangents left at zero by an object stay zero)
+	vec3 transform_direction(const vec3& v) const {
+		vec3 w = object_to_world.transform_vector(v);
+		double len_sq = w.length_squared();
+		return (len_sq > 0.0) ? w / std::sqrt(len_sq) : w;
+	}
+};
\ No newline at end of file
@@ -1,42 +1,11 @@
 #pragma once
 
-#include "hittable.hpp"
-#include "vec3.hpp"
+#include "transform_instance.hpp"
 
-class translate : public hittable {
+//moves the object by displacement, kept as a shorthand for a translation instance
+class translate : public transform_instance {
 public:
 	translate(shared_ptr<hittable> p, const vec3& displacement)
-		: ptr(p)
-		, offset(displacement)
-	{
-		bbox = ptr->bounding_box() + offset;
-	}
-
-	virtual bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
-		//world -> local(move ray in opposite direction of offset)
-		ray moved_r(
-			r.origin() - offset, 
-			r.direction()
-		);
-
-		if (!ptr->hit(moved_r, ray_t, rec)) {
-			return false;
-		}
-
-		//local -> world(move intersection point back)
-		rec.p += offset;
-		//normal remains the same(no rotation applied)
-		rec.set_face_normal(r, rec.normal);
-
-		return true;
-	}
-
-	aabb bounding_box() const override { 
-		return bbox; 
-	}
-
-private:
-	shared_ptr<hittable> ptr;
-	vec3 offset;
-	aabb bbox;
+		: transform_instance(p, affine_transform::translation(displacement))
+	{}
 };
\ No newline at end of file
@@ -2,110 +2,187 @@
 
 #include "hittable.hpp"
 
+//texture coordinate of a vertex
+struct triangle_uv {
+	double u = 0.0;
+	double v = 0.0;
+};
+
+//watertight ray/triangle test (Woop, Benthin, Wald 2013): vertices are moved into a ray space where
+//the ray runs along +z, so the 2D edge tests of neighbouring triangles use the same numbers
+//and a ray can't slip through a shared edge or vertex
+//on a hit inside ray_t returns t and the barycentric weights w of v0, v1, v2
+inline bool watertight_triangle_hit(const ray& r, const point3& v0, const point3& v1, const point3& v2,
+	const interval& ray_t, double& t, double w[3]) {
+	const int kx = r.shear_axis[0];
+	const int ky = r.shear_axis[1];
+	const int kz = r.shear_axis[2];
+	const vec3& s = r.shear;
+
+	//vertices relative to the ray origin
+	vec3 A = v0 - r.origin();
+	vec3 B = v1 - r.origin();
+	vec3 C = v2 - r.origin();
+
+	//shear and scale (z is only scaled later, when the hit is known)
+	double ax = A[kx] - s.x() * A[kz];
+	double ay = A[ky] - s.y() * A[kz];
+	double bx = B[kx] - s.x() * B[kz];
+	double by = B[ky] - s.y() * B[kz];
+	double cx = C[kx] - s.x() * C[kz];
+	double cy = C[ky] - s.y() * C[kz];
+
+	//scaled barycentrics (edge functions), all must share a sign
+	double U = cx * by - cy * bx;
+	double V = ax * cy - ay * cx;
+	double W = bx * ay - by * ax;
+	if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0)) {
+		return false;
+	}
+
+	double det = U + V + W;
+	if (det == 0.0) {
+		return false; //ray in the triangle plane
+	}
+
+	double T = s.z() * (U * A[kz] + V * B[kz] + W * C[kz]);
+	double inv_det = 1.0 / det;
+	t = T * inv_det;
+	if (!ray_t.contains(t)) {
+		return false;
+	}
+	w[0] = U * inv_det;
+	w[1] = V * inv_det;
+	w[2] = W * inv_det;
+	return true;
+}
+
+//box around a triangle, with a small margin (padding) to avoid zero thickness
+inline aabb triangle_bounds(const point3& v0, const point3& v1, const point3& v2) {
+	//searching for min and max points for each axis
+	double min_x = fmin(v0.x(), fmin(v1.x(), v2.x()));
+	double min_y = fmin(v0.y(), fmin(v1.y(), v2.y()));
+	double min_z = fmin(v0.z(), fmin(v1.z(), v2.z()));
+
+	double max_x = fmax(v0.x(), fmax(v1.x(), v2.x()));
+	double max_y = fmax(v0.y(), fmax(v1.y(), v2.y()));
+	double max_z = fmax(v0.z(), fmax(v1.z(), v2.z()));
+
+	double delta = 0.0001;
+	if (max_x - min_x < delta) { min_x -= delta; max_x += delta; }
+	if (max_y - min_y < delta) { min_y -= delta; max_y += delta; }
+	if (max_z - min_z < delta) { min_z -= delta; max_z += delta; }
+
+	return aabb(point3(min_x, min_y, min_z), point3(max_x, max_y, max_z));
+}
+
+//any unit vector perpendicular to n (same choice as spheres)
+inline vec3 any_tangent(const vec3& n) {
+	vec3 t = cross(vec3(0, 1, 0), n);
+	if (t.length_squared() < 0.001) {
+		t = cross(vec3(0, 0, 1), n);
+	}
+	return unit_vector(t);
+}
+
+//direction of increasing u on the triangle plane (dP/du from the uv deltas of the two edges)
+inline vec3 triangle_tangent(const vec3& edge1, const vec3& edge2, triangle_uv uv0, triangle_uv uv1, triangle_uv uv2, const vec3& normal) {
+	double du1 = uv1.u - uv0.u, dv1 = uv1.v - uv0.v;
+	double du2 = uv2.u - uv0.u, dv2 = uv2.v - uv0.v;
+	double uv_det = du1 * dv2 - du2 * dv1;
+	if (std::abs(uv_det) < 1e-12) {
+		return any_tangent(normal); //degenerate uv mapping
+	}
+	return unit_vector((dv2 * edge1 - dv1 * edge2) / uv_det);
+}
+
+//tangent frame for bump mapping: the tangent is made orthogonal to the (face-oriented) shading normal
+inline void set_tangent_frame(hit_record& rec, const vec3& tangent) {
+	vec3 t_ortho = tangent - dot(tangent, rec.normal) * rec.normal;
+	double t_len_sq = t_ortho.length_squared();
+	rec.tangent = (t_len_sq > 1e-12) ? t_ortho / std::sqrt(t_len_sq) : any_tangent(rec.normal);
+	rec.bitangent = cross(rec.normal, rec.tangent);
+}
+
 class triangle : public hittable {
 public:
+	//without texture coordinates the barycentrics are used as uv (v0 = (0,0), v1 = (1,0), v2 = (0,1))
 	triangle(const point3& a, const point3& b, const point3& c, const vec3& _n0, const vec3& _n1, const vec3& _n2, shared_ptr<material>m)
+		: triangle(a, b, c, _n0, _n1, _n2, triangle_uv{ 0.0, 0.0 }, triangle_uv{ 1.0, 0.0 }, triangle_uv{ 0.0, 1.0 }, m)
+	{}
+
+	triangle(const point3& a, const point3& b, const point3& c, const vec3& _n0, const vec3& _n1, const vec3& _n2,
+		triangle_uv _uv0, triangle_uv _uv1, triangle_uv _uv2, shared_ptr<material>m)
 		: v0(a) //first vertex of the triangle
 		, v1(b) //second vertex of the triangle
 		, v2(c) //third vertex of the triangle
 		, n0(_n0) //normal at vertex v0
 		, n1(_n1) //normal at vertex v1
 		, n2(_n2) //normal at vertex v2
+		, uv0(_uv0)
+		, uv1(_uv1)
+		, uv2(_uv2)
 		, mat_ptr(m) //material pointer for the triangle
-	{}
+	{
+		precompute();
+	}
 
 	virtual bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const {
-		//edges
-		vec3 edge1 = v1 - v0;
-		vec3 edge2 = v2 - v0;
-		//normal 
-		vec3 normal = cross(edge1, edge2);
-		double normal_length = normal.length();
-
-		if (normal_length < 1e-8) {
-			return false; //degenerate triangle
-		}
-
-		vec3 unit_normal = normal / normal_length;
-
-		//check if cut the plane
-		double NdotD = dot(unit_normal, r.direction());
-		//if the ray is parallel or points away from the triangle
-		if (std::abs(NdotD) < 1e-8) {
-			return false;
-		}
-
-		double D = dot(unit_normal, v0); // D from plane equation N*P = D
-		double t = (D - dot(unit_normal, r.origin())) / NdotD;
-
-		if (!ray_t.contains(t)) {
+		double t, w[3];
+		if (degenerate || !watertight_triangle_hit(r, v0, v1, v2, ray_t, t, w)) {
 			return false;
 		}
 
-		//find the intersection point and check if it's inside the triangle
-		point3 p = r.at(t);
-
-		//point p tests with respect to edges(outside-in test)
-		//checking if p-point is located on the internal vector side for each edge
-
-		//calculate vectors for edges
-		vec3 edge_v0v1 = v1 - v0;
-		vec3 edge_v1v2 = v2 - v1;
-		vec3 edge_v2v0 = v0 - v2;
-
-		//calculate barycentric coordinates for normal interpolation (triangles areas method)
-		vec3 C0 = cross(v1 - v0, p - v0);
-		vec3 C1 = cross(v2 - v1, p - v1);
-		vec3 C2 = cross(v0 - v2, p - v2);
-
-		//inside-outside test
-		if (dot(normal, C0) < 0 || dot(normal, C1) < 0 || dot(normal, C2) < 0) {
-			return false;
-		}
-
-		double area_total_sq = dot(normal, normal); //normal.length()^2
-		//u,v,w are the ratios of the small triangle areas to the whole
-		double u = dot(normal, C2) / area_total_sq; //weight for vertex v1
-		double v = dot(normal, C0) / area_total_sq; //weight for vertex v2
-		double w = 1.0 - u - v; //weight for vertex v0
-
 		//interpolated normal
-		vec3 smooth_normal = unit_vector(w * n0 + u * n1 + v * n2);
+		vec3 smooth_normal = unit_vector(w[0] * n0 + w[1] * n1 + w[2] * n2);
 
 		//if we reach this point, the ray hits the triangle
 		rec.t = t;
-		rec.p = p;
+		rec.p = r.at(t);
 		rec.mat = mat_ptr;
+		rec.object = this;
 		rec.set_face_normal(r, smooth_normal);
 
+		//texture coordinates
+		rec.u = w[0] * uv0.u + w[1] * uv1.u + w[2] * uv2.u;
+		rec.v = w[0] * uv0.v + w[1] * uv1.v + w[2] * uv2.v;
+
+		set_tangent_frame(rec, tangent);
 		return true;
 	}
 
 	aabb bounding_box() const override {
-		//searching for min and max points for each axis
-		double min_x = fmin(v0.x(), fmin(v1.x(), v2.x()));
-		double min_y = fmin(v0.y(), fmin(v1.y(), v2.y()));
-		double min_z = fmin(v0.z(), fmin(v1.z(), v2.z()));
-
-		double max_x = fmax(v0.x(), fmax(v1.x(), v2.x()));
-		double max_y = fmax(v0.y(), fmax(v1.y(), v2.y()));
-		double max_z = fmax(v0.z(), fmax(v1.z(), v2.z()));
-
-		//adding small margin (padding) to avoid zero thickness
-		double delta = 0.0001;
-		if (max_x - min_x < delta) { min_x -= delta; max_x += delta; }
-		if (max_y - min_y < delta) { min_y -= delta; max_y += delta; }
-		if (max_z - min_z < delta) { min_z -= delta; max_z += delta; }
-
-		return aabb(point3(min_x, min_y, min_z), point3(max_x, max_y, max_z));
+		return triangle_bounds(v0, v1, v2);
 	}
 
 	void set_material(std::shared_ptr<material> m) {
 		mat_ptr = m;
 	}
 
+	//unit geometric normal (v0, v1, v2 counter-clockwise)
+	const vec3& geometric_normal() const {
+		return normal;
+	}
+
 private:
 	point3 v0, v1, v2;
 	vec3 n0, n1, n2; //new areas
+	triangle_uv uv0, uv1, uv2;
 	shared_ptr<material> mat_ptr;
+
+	//computed once in the constructor
+	vec3 normal;  //unit geometric normal
+	vec3 tangent; //direction of increasing u on the triangle plane
+	bool degenerate = false;
+
+	void precompute() {
+		vec3 n = cross(v1 - v0, v2 - v0);
+		double n_len = n.length();
+		degenerate = n_len < 1e-12;
+		if (degenerate) {
+			return;
+		}
+		normal = n / n_len;
+		tangent = triangle_tangent(v1 - v0, v2 - v0, uv0, uv1, uv2, normal);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "hittable.hpp"
+#include "triangle.hpp"
+#include "wide_bvh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//one corner of a face: indices into the position, normal and uv arrays (-1 = not present), as in .obj files
+struct mesh_corner {
+	int32_t position = 0;
+	int32_t normal = -1;
+	int32_t uv = -1;
+};
+
+//flat vertex arrays and index buffer of a mesh (3 corners per triangle)
+struct mesh_data {
+	std::vector<point3> positions;
+	std::vector<vec3> normals;
+	std::vector<triangle_uv> uvs;
+	std::vector<mesh_corner> corners;
+
+	size_t triangle_count() const {
+		return corners.size() / 3;
+	}
+
+	size_t memory_bytes() const {
+		return positions.size() * sizeof(point3) + normals.size() * sizeof(vec3)
+			+ uvs.size() * sizeof(triangle_uv) + corners.size() * sizeof(mesh_corner);
+	}
+};
+
+//indexed triangle mesh: shared vertex arrays + index buffer instead of one object per triangle
+//the BVH is built over triangle numbers, afterwards the faces are stored in leaf order so a leaf slot is the triangle number
+class triangle_mesh : public hittable {
+public:
+	triangle_mesh(mesh_data data, shared_ptr<material> mat, bvh_layout layout = global_settings::active_bvh_layout)
+		: mesh(std::move(data))
+		, mat(mat)
+		, layout(layout)
+	{
+		build();
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		if (accelerator == nullptr) {
+			return false;
+		}
+
+		if (global_settings::bvh_debug_mode) {
+			return with_accelerator([&](const auto& bvh) {
+				return bvh.traverse_debug(r, ray_t, rec, [&](uint32_t tri, interval& t) {
+					double t_hit, w[3];
+					if (!intersect(tri, r, t, t_hit, w)) {
+						return false;
+					}
+					fill_record(tri, r, t_hit, w, rec);
+					t.max = t_hit;
+					return true;
+				});
+			});
+		}
+
+		//only the closest triangle fills the record (once, after the traversal)
+		uint32_t hit_tri = 0;
+		double hit_t = 0.0;
+		double hit_w[3] = { 0.0, 0.0, 0.0 };
+		bool found = with_accelerator([&](const auto& bvh) {
+			return bvh.traverse(r, ray_t, [&](uint32_t tri, interval& t) {
+				double t_hit, w[3];
+				if (!intersect(tri, r, t, t_hit, w)) {
+					return false;
+				}
+				hit_tri = tri;
+				hit_t = t_hit;
+				hit_w[0] = w[0];
+				hit_w[1] = w[1];
+				hit_w[2] = w[2];
+				t.max = t_hit;
+				return true;
+			});
+		});
+		if (found) {
+			fill_record(hit_tri, r, hit_t, hit_w, rec);
+		}
+		return found;
+	}
+
+	aabb bounding_box() const override {
+		return bbox;
+	}
+
+	void set_material(std::shared_ptr<material> m) {
+		mat = m;
+	}
+
+	size_t triangle_count() const {
+		return mesh.triangle_count();
+	}
+
+	//vertex and index buffers (without the BVH nodes)
+	size_t memory_bytes() const {
+		return mesh.memory_bytes();
+	}
+
+	const bvh_stats& stats() const {
+		return build_stats;
+	}
+
+private:
+	mesh_data mesh;
+	shared_ptr<material> mat;
+	bvh_layout layout;
+	shared_ptr<flat_bvh> accelerator;
+	aabb bbox;
+	bvh_stats build_stats;
+
+	void build() {
+		size_t count = mesh.triangle_count();
+		if (count == 0) {
+			return;
+		}
+
+		std::vector<aabb> boxes(count);
+		int n = static_cast<int>(count);
+		parallel_for(n, [&](int i) {
+			boxes[i] = triangle_bounds(position(i, 0), position(i, 1), position(i, 2));
+		}, count >= bvh_sah::parallel_threshold);
+
+		//index-only tree, flattened right away (the binary tree is freed here)
+		{
+			bvh_node root(boxes);
+			build_stats = root.stats();
+			accelerator = make_bvh_accelerator(root, layout);
+		}
+		bbox = accelerator->bounding_box();
+
+		//faces in leaf order: slot i of the accelerator is triangle i
+		const std::vector<uint32_t>& order = accelerator->primitive_order();
+		std::vector<mesh_corner> sorted(mesh.corners.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			for (int k = 0; k < 3; k++) {
+				sorted[3 * i + k] = mesh.corners[3 * static_cast<size_t>(order[i]) + k];
+			}
+		}
+		mesh.corners.swap(sorted);
+	}
+
+	//the accelerator always has the concrete type of the layout it was built with
+	template <typename F>
+	bool with_accelerator(F&& f) const {
+		switch (layout) {
+		case bvh_layout::WIDE_4:
+			return f(static_cast<const wide_bvh<4>&>(*accelerator));
+		case bvh_layout::WIDE_8:
+			return f(static_cast<const wide_bvh<8>&>(*accelerator));
+		default:
+			return f(static_cast<const linear_bvh&>(*accelerator));
+		}
+	}
+
+	const point3& position(size_t tri, int k) const {
+		return mesh.positions[mesh.corners[3 * tri + k].position];
+	}
+
+	bool intersect(uint32_t tri, const ray& r, const interval& ray_t, double& t, double w[3]) const {
+		return watertight_triangle_hit(r, position(tri, 0), position(tri, 1), position(tri, 2), ray_t, t, w);
+	}
+
+	void fill_record(uint32_t tri, const ray& r, double t, const double w[3], hit_record& rec) const {
+		const mesh_corner* c = &mesh.corners[3 * static_cast<size_t>(tri)];
+		const point3& p0 = mesh.positions[c[0].position];
+		const point3& p1 = mesh.positions[c[1].position];
+		const point3& p2 = mesh.positions[c[2].position];
+		vec3 edge1 = p1 - p0;
+		vec3 edge2 = p2 - p0;
+		vec3 geometric_normal = unit_vector(cross(edge1, edge2));
+
+		//interpolated normal, flat shading when the file has no normals
+		vec3 shading_normal = geometric_normal;
+		if (c[0].normal >= 0 && c[1].normal >= 0 && c[2].normal >= 0) {
+			shading_normal = unit_vector(w[0] * mesh.normals[c[0].normal] + w[1] * mesh.normals[c[1].normal] + w[2] * mesh.normals[c[2].normal]);
+		}
+
+		rec.t = t;
+		rec.p = r.at(t);
+		rec.mat = mat;
+		rec.object = this;
+		rec.set_face_normal(r, shading_normal);
+
+		//texture coordinates, barycentric uv when the file has none (same as triangle)
+		triangle_uv uv0{ 0.0, 0.0 }, uv1{ 1.0, 0.0 }, uv2{ 0.0, 1.0 };
+		if (c[0].uv >= 0 && c[1].uv >= 0 && c[2].uv >= 0) {
+			uv0 = mesh.uvs[c[0].uv];
+			uv1 = mesh.uvs[c[1].uv];
+			uv2 = mesh.uvs[c[2].uv];
+		}
+		rec.u = w[0] * uv0.u + w[1] * uv1.u + w[2] * uv2.u;
+		rec.v = w[0] * uv0.v + w[1] * uv1.v + w[2] * uv2.v;
+
+		set_tangent_frame(rec, triangle_tangent(edge1, edge2, uv0, uv1, uv2, geometric_normal));
+	}
+};
\ No newline at end of file
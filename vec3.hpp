@@ -7,7 +7,7 @@
 class vec3 {
 public:
 	//variable for x, y and z
-	double e[3];
+	real e[3];
 
 	//default constructor: initializes to (0, 0, 0)
 	constexpr vec3() 
@@ -15,16 +15,16 @@ public:
 	{}
 
 	//parameterized constructor: initializes to specific values (e0, e1, e2)
-	constexpr vec3(double e0, double e1, double e2) : e{ e0, e1, e2 } {}
+	constexpr vec3(real e0, real e1, real e2) : e{ e0, e1, e2 } {}
 
 	//getter methods for individual components (x, y, z))
-	constexpr double x() const { 
+	constexpr real x() const { 
 		return e[0];
 	}
-	constexpr double y() const { 
+	constexpr real y() const { 
 		return e[1]; 
 	}
-	constexpr double z() const {
+	constexpr real z() const {
 		return e[2];
 	}
 
@@ -34,10 +34,10 @@ public:
 	}
 
 	//array index operators
-	constexpr double operator[](int i) const { 
+	constexpr real operator[](int i) const { 
 		return e[i];
 	}
-	double& operator[](int i) {
+	real& operator[](int i) {
 		return e[i];
 	}
 
@@ -50,7 +50,7 @@ public:
 	}
 
 	//multiplication assignment (v *= scalar)
-	vec3& operator*=(double t) {
+	vec3& operator*=(real t) {
 		e[0] *= t;
 		e[1] *= t;
 		e[2] *= t;
@@ -74,17 +74,17 @@ public:
 	}
 
 	//division assignment (v /= scalar)
-	vec3& operator/=(double t) {
+	vec3& operator/=(real t) {
 		return *this *= 1 / t;
 	}
 
 	//length (magnitude) of the vector
-	double length() const {
+	real length() const {
 		return std::sqrt(length_squared());
 	}
 
 	//length squared (no square root for efficiency)
-	constexpr double length_squared() const {
+	constexpr real length_squared() const {
 		return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
 	}
 
@@ -98,12 +98,12 @@ public:
 	static vec3 random() {
 		return vec3(random_double(), random_double(), random_double());
 	}
-	static vec3 random(double min, double max) {
+	static vec3 random(real min, real max) {
 		return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
 	}
 
 	//luminance calculation using Rec. 709 coefficients
-	double luminance() const {
+	real luminance() const {
 		return 0.2126 * e[0] + 0.7152 * e[1] + 0.0722 * e[2];
 	}
 };
@@ -136,22 +136,22 @@ inline vec3 operator*(const vec3& u, const vec3& v) {
 }
 
 //multiply by scalar
-inline vec3 operator*(double t, const vec3& v) {
+inline vec3 operator*(real t, const vec3& v) {
 	return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
 //scalar multiplication (v * t)
-inline vec3 operator*(const vec3& v, double t) {
+inline vec3 operator*(const vec3& v, real t) {
 	return t * v;
 }
 
 //scalar division (v / t)
-inline vec3 operator/(const vec3& v, double t) {
+inline vec3 operator/(const vec3& v, real t) {
 	return (1 / t) * v;
 }
 
 //dot product of two vectors (u . v)
-inline double dot(const vec3& u, const vec3& v) {
+inline real dot(const vec3& u, const vec3& v) {
 	return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
 }
 // cross product
@@ -163,31 +163,66 @@ inline vec3 cross(const vec3& u, const vec3& v) {
 
 //return unit vector with length = 1 with the same direction to v
 inline vec3 unit_vector(const vec3& v) {
-	double len = v.length();
+	real len = v.length();
 	if (len < 1e-8) { 
 		return vec3(0, 0, 0); //safeguard against division by zero
 	} 
 	return v / len;
 }
 
+//closed-form sample mappings: two uniform numbers in [0,1) give one sample, no rejection loop
+
+//point in the unit disk on the XY surface, concentric mapping (Shirley-Chiu) keeps neighbouring inputs together
+inline vec3 unit_disk_from_uniform(real u1, real u2) {
+	real a = 2.0 * u1 - 1.0;
+	real b = 2.0 * u2 - 1.0;
+	if (a == 0.0 && b == 0.0) {
+		return vec3(0, 0, 0);
+	}
+	real r, theta;
+	if (std::fabs(a) > std::fabs(b)) {
+		r = a;
+		theta = (pi / 4.0) * (b / a);
+	} else {
+		r = b;
+		theta = (pi / 2.0) - (pi / 4.0) * (a / b);
+	}
+	return vec3(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+//uniform direction on the unit sphere
+inline vec3 unit_vector_from_uniform(real u1, real u2) {
+	real z = 1.0 - 2.0 * u1;
+	real r = std::sqrt(std::fmax(0.0, 1.0 - z * z));
+	real phi = 2.0 * pi * u2;
+	return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+//cosine-weighted direction on the hemisphere around +Z (Malley: disk point lifted onto the hemisphere)
+inline vec3 cosine_hemisphere_from_uniform(real u1, real u2) {
+	vec3 d = unit_disk_from_uniform(u1, u2);
+	real z = std::sqrt(std::fmax(0.0, 1.0 - d.x() * d.x() - d.y() * d.y()));
+	return vec3(d.x(), d.y(), z);
+}
+
+//local (+Z up) direction rotated into the frame around unit normal n (branchless basis, Duff et al. 2017)
+inline vec3 to_normal_frame(const vec3& local, const vec3& n) {
+	real sign = std::copysign(1.0, n.z());
+	real a = -1.0 / (sign + n.z());
+	real b = n.x() * n.y() * a;
+	vec3 t(1.0 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+	vec3 bt(b, sign + n.y() * n.y() * a, -n.y());
+	return local.x() * t + local.y() * bt + local.z() * n;
+}
+
 //generate random vector inside unit disk on XY surface (disk with radius 1 and center(0,0,0))
 inline vec3 random_in_unit_disk() {
-	while (true) {
-		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0); //generate random point in 2D surface
-		if (p.length_squared() < 1) { //checking if point is located on disk
-			return p; //return random point located inside determined disk
-		}
-	}
+	return unit_disk_from_uniform(random_double(), random_double());
 }
 
-//generate a random unit vecto
+//generate a random unit vector
 inline vec3 random_unit_vector() {
-	while (true) {
-		auto p = vec3::random(-1, 1);
-		auto lensq = p.length_squared();
-		if (1e-160 < lensq && lensq <= 1)
-			return p / sqrt(lensq);
-	}
+	return unit_vector_from_uniform(random_double(), random_double());
 }
 
 //generate a random vector on the hemisphere defined by the normal
@@ -206,7 +241,7 @@ inline vec3 reflect(const vec3& v, const vec3& n) {
 }
 
 //refraction function (Snell's Law)
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
+inline vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat) {
 	auto cos_theta = std::fmin(dot(-uv, n), 1.0); //angle of incidence (cos⁡θ1)
 	vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n); //perpendicular component (r_out_perp​)
 	vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n; // parallel component (r_out_parallel​)
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "material.hpp"
+#include "lights.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//state of all paths of a work unit (tile) in SoA form, index = path
+//every path keeps its own random generator and sampler, so the stages can process paths in any order
+//and the image stays the same as tracing one path after another
+class path_queue {
+public:
+	std::vector<ray> rays; //ray to intersect next (or the ray that produced recs[path])
+	std::vector<hit_record> recs; //last surface hit
+	std::vector<color> throughput; //product of the attenuations so far
+	std::vector<color> radiance; //light gathered so far (result once the path ended)
+	std::vector<pcg32> rngs;
+	std::vector<pixel_sampler> samplers;
+	std::vector<int> bounces; //surfaces hit before the one in recs
+	std::vector<double> bsdf_pdfs; //density the last surface scattered the ray with (0 = camera ray or specular)
+	std::vector<int> owners; //slot of the caller (pixel) the path belongs to
+
+	int size() const {
+		return static_cast<int>(rays.size());
+	}
+
+	void clear() {
+		rays.clear();
+		recs.clear();
+		throughput.clear();
+		radiance.clear();
+		rngs.clear();
+		samplers.clear();
+		bounces.clear();
+		bsdf_pdfs.clear();
+		owners.clear();
+		to_trace.clear();
+		to_shade.clear();
+	}
+
+	//path starting with ray r, continues the current generator and sampler of the calling thread
+	int add(const ray& r, int owner) {
+		int path = push(r, owner);
+		to_trace.push_back(path);
+		return path;
+	}
+
+	//path whose first hit is already known (camera rays traced as packets), it starts at the shading stage
+	int add_hit(const ray& r, const hit_record& rec, int owner) {
+		int path = push(r, owner);
+		recs[path] = rec;
+		to_shade.push_back(path);
+		return path;
+	}
+
+private:
+	friend class wavefront_integrator;
+
+	//stage queues: paths waiting for an intersection, paths waiting for shading, paths that left the scene
+	std::vector<int> to_trace;
+	std::vector<int> to_shade;
+	std::vector<int> missed;
+
+	//scratch of the material sort
+	std::vector<const material*> sort_keys;
+	std::vector<int> sort_offsets;
+	std::vector<int> sort_buckets;
+	std::vector<int> sorted;
+
+	int push(const ray& r, int owner) {
+		rays.push_back(r);
+		recs.emplace_back();
+		throughput.push_back(color(1.0, 1.0, 1.0));
+		radiance.push_back(color(0.0, 0.0, 0.0));
+		rngs.push_back(thread_rng());
+		samplers.push_back(thread_sampler());
+		bounces.push_back(0);
+		bsdf_pdfs.push_back(0.0);
+		owners.push_back(owner);
+		return static_cast<int>(rays.size()) - 1;
+	}
+};
+
+//wavefront path tracer: instead of one path running through all its bounces (camera::ray_color),
+//all paths of a queue advance one bounce at a time in separate batched stages:
+//intersection -> miss (environment) -> sort by material -> shading, until no path is left.
+//The traversal stays hot in cache for a whole batch, and sorted shading runs the same material
+//(same virtual scatter, same textures) over consecutive paths instead of alternating glass, metal and diffuse
+class wavefront_integrator {
+public:
+	int max_depth = 10; //surfaces a path may hit, same meaning as the depth of camera::ray_color_from_hit
+	const scene_lights* lights = nullptr; //next-event estimation at every bounce when set
+
+	//trace every path of the queue until it ends, background(ray, mis_weight) is the radiance of rays leaving the scene
+	//(mis_weight: MIS weight of the sun disc or HDR map with light sampling, see camera::get_background_color);
+	//returns the number of rays intersected (shadow rays not included)
+	template <typename Background>
+	long long trace(const hittable& world, path_queue& paths, Background&& background) const {
+		long long rays_traced = 0;
+		while (!paths.to_trace.empty() || !paths.to_shade.empty()) {
+			rays_traced += static_cast<long long>(paths.to_trace.size());
+			intersect(world, paths);
+			resolve_misses(paths, background);
+			sort_by_material(paths);
+			shade(world, paths);
+		}
+		return rays_traced;
+	}
+
+private:
+	//closest hit of every waiting ray (the generator is swapped in because media sample inside hit())
+	void intersect(const hittable& world, path_queue& paths) const {
+		pcg32& rng = thread_rng();
+		for (int path : paths.to_trace) {
+			rng = paths.rngs[path];
+			if (world.hit(paths.rays[path], interval(0.001, infinity), paths.recs[path])) {
+				paths.to_shade.push_back(path);
+			} else {
+				paths.missed.push_back(path);
+			}
+			paths.rngs[path] = rng;
+		}
+		paths.to_trace.clear();
+	}
+
+	template <typename Background>
+	void resolve_misses(path_queue& paths, Background& background) const {
+		for (int path : paths.missed) {
+			const ray& r = paths.rays[path];
+			double mis_weight = lights ? lights->environment_weight(r.direction(), paths.bsdf_pdfs[path]) : 1.0;
+			paths.radiance[path] += paths.throughput[path] * background(r, mis_weight);
+		}
+		paths.missed.clear();
+	}
+
+	//group the hits by material (counting sort over the few distinct materials of a batch),
+	//the order inside a group stays the path order (memory order of the SoA arrays)
+	void sort_by_material(path_queue& paths) const {
+		std::vector<const material*>& keys = paths.sort_keys;
+		std::vector<int>& offsets = paths.sort_offsets;
+		std::vector<int>& bucket = paths.sort_buckets;
+		keys.clear();
+		offsets.clear();
+		bucket.resize(paths.to_shade.size());
+
+		int last = -1;
+		for (size_t n = 0; n < paths.to_shade.size(); n++) {
+			const material* mat = paths.recs[paths.to_shade[n]].mat.get();
+			//neighbouring paths usually hit the same material, try the previous one first
+			if (last < 0 || keys[last] != mat) {
+				last = static_cast<int>(std::find(keys.begin(), keys.end(), mat) - keys.begin());
+				if (last == static_cast<int>(keys.size())) {
+					keys.push_back(mat);
+					offsets.push_back(0);
+				}
+			}
+			bucket[n] = last;
+			offsets[last]++;
+		}
+		if (keys.size() < 2) {
+			return;
+		}
+
+		int start = 0;
+		for (int& offset : offsets) {
+			int count = offset;
+			offset = start;
+			start += count;
+		}
+		paths.sorted.resize(paths.to_shade.size());
+		for (size_t n = 0; n < paths.to_shade.size(); n++) {
+			paths.sorted[offsets[bucket[n]]++] = paths.to_shade[n];
+		}
+		paths.to_shade.swap(paths.sorted);
+	}
+
+	//emission, direct light and scattering of every hit, the same bounce logic as camera::ray_color
+	//(the shadow rays of the light samples are traced right here, one per diffuse hit)
+	void shade(const hittable& world, path_queue& paths) const {
+		pcg32& rng = thread_rng();
+		pixel_sampler& sampler = thread_sampler();
+		for (int path : paths.to_shade) {
+			rng = paths.rngs[path];
+			sampler = paths.samplers[path];
+
+			const hit_record& rec = paths.recs[path];
+			color& throughput = paths.throughput[path];
+			const ray& r_in = paths.rays[path];
+			color emitted = rec.mat->emitted(rec.u, rec.v, rec.p);
+			if (lights) {
+				emitted *= lights->emission_weight(r_in.origin(), rec, paths.bsdf_pdfs[path]);
+				emitted += lights->sample_direct(world, r_in, rec);
+			}
+			paths.radiance[path] += throughput * emitted;
+
+			//bounce index as counted by ray_color, whose loop starts at the second hit
+			int i = paths.bounces[path] - 1;
+			bool alive = false;
+			ray scattered;
+			color attenuation;
+			if (rec.mat->scatter(r_in, rec, attenuation, scattered)) {
+				throughput *= attenuation;
+				paths.bsdf_pdfs[path] = 0.0;
+				color f_cos;
+				if (lights) {
+					rec.mat->eval_scatter(r_in, rec, unit_vector(scattered.direction()), f_cos, paths.bsdf_pdfs[path]);
+				}
+				paths.rays[path] = scattered;
+				alive = !(i > 10 && throughput.length() < 0.0001); //early termination for very weak rays
+
+				//russian roulette
+				if (alive && i > 10) {
+					double p = std::max({ throughput.x(), throughput.y(), throughput.z() });
+					p = std::clamp(p, 0.05, 0.95);
+					if (sampled_double() > p) {
+						alive = false;
+					} else {
+						throughput /= p;
+					}
+				}
+			}
+
+			paths.rngs[path] = rng;
+			paths.samplers[path] = sampler;
+			if (alive && ++paths.bounces[path] < max_depth) {
+				paths.to_trace.push_back(path);
+			}
+		}
+		paths.to_shade.clear();
+	}
+};
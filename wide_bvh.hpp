@@ -0,0 +1,531 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "linear_bvh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+//instruction set used by the wide slab test (shown in the Engine Info panel)
+#if defined(ZENITH_WIDE_BVH_AVX)
+inline constexpr const char* wide_bvh_simd_path = "AVX";
+#elif defined(ZENITH_WIDE_BVH_SSE)
+inline constexpr const char* wide_bvh_simd_path = "SSE";
+#else
+inline constexpr const char* wide_bvh_simd_path = "scalar";
+#endif
+
+//N child boxes in SoA form, tested against a ray in one SIMD slab test
+//empty slots hold an inverted box (+inf, -inf) which never passes the test
+template <int N>
+struct alignas(32) wide_bvh_node {
+	float min_x[N], min_y[N], min_z[N];
+	float max_x[N], max_y[N], max_z[N];
+	uint32_t child[N]; //interior: node index, leaf: first primitive
+	uint16_t prim_count[N]; //0 marks an interior child
+	uint8_t child_count = 0;
+};
+
+//per-ray data of the float slab test
+struct wide_bvh_ray {
+	float near_origin[3]; //origin nudged so the boxes are tested slightly enlarged (covers the double -> float rounding)
+	float far_origin[3];
+	float inv_dir[3];
+
+	wide_bvh_ray(const ray& r) {
+		const point3& o = r.origin();
+		double max_abs = std::max({ std::abs(o.x()), std::abs(o.y()), std::abs(o.z()) });
+		float eps = static_cast<float>(max_abs * 0x1p-22);
+		for (int a = 0; a < 3; a++) {
+			inv_dir[a] = static_cast<float>(r.inv_direction()[a]);
+			float s = r.dir_neg[a] ? -eps : eps;
+			near_origin[a] = static_cast<float>(o[a]) + s;
+			far_origin[a] = static_cast<float>(o[a]) - s;
+		}
+	}
+};
+
+//BVH with 4 (QBVH) or 8 (OBVH) children per node, collapsed from the binary SAH tree
+template <int N>
+class wide_bvh : public flat_bvh {
+	static_assert(N == 4 || N == 8, "wide_bvh supports 4 or 8 children per node");
+
+public:
+	using node = wide_bvh_node<N>;
+
+	wide_bvh(const hittable_list& list)
+		: wide_bvh(bvh_node(list)) {
+	}
+
+	wide_bvh(const bvh_node& root)
+		: bbox(root.bounding_box()) {
+		nodes.emplace_back();
+		std::vector<const bvh_node*> children;
+		if (root.left == nullptr) {
+			children.push_back(&root); //the whole tree is a single leaf
+		} else {
+			collapse(root, children);
+		}
+		fill(0, children, 0);
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec, int depth = 0, bool debug_wire = false) const override {
+		if (primitives.empty()) {
+			return false;
+		}
+		auto hit_prim = [&](uint32_t prim, interval& t) {
+			if (primitives[prim]->hit(r, t, rec)) {
+				t.max = rec.t;
+				return true;
+			}
+			return false;
+		};
+		if (global_settings::bvh_debug_mode) {
+			return traverse_debug(r, ray_t, rec, hit_prim);
+		}
+		return traverse(r, ray_t, hit_prim);
+	}
+
+	//camera ray packets share the node visits, primitives are still tested ray by ray
+	void hit_packet(const ray* rays, int count, interval ray_t, hit_record* recs, bool* hits) const override {
+		if (primitives.empty() || global_settings::bvh_debug_mode || count > ray_packet::max_size) {
+			hittable::hit_packet(rays, count, ray_t, recs, hits);
+			return;
+		}
+		ray_packet packet(rays, count, ray_t);
+		interval lane_t[ray_packet::max_size];
+		for (int k = 0; k < count; k++) {
+			lane_t[k] = ray_t;
+			hits[k] = false;
+		}
+		traverse_packet(packet, lane_t, [&](int lane, uint32_t prim, interval& t) {
+			if (primitives[prim]->hit(rays[lane], t, recs[lane])) {
+				t.max = recs[lane].t;
+				hits[lane] = true;
+				return true;
+			}
+			return false;
+		});
+	}
+
+	aabb bounding_box() const override {
+		return bbox;
+	}
+
+	size_t node_count() const override {
+		return nodes.size();
+	}
+
+	//child nodes always have higher indices than their parent, a backwards sweep refits bottom-up
+	void refit() override {
+		if (primitives.empty()) {
+			return;
+		}
+		for (size_t i = nodes.size(); i-- > 0;) {
+			node& n = nodes[i];
+			for (int c = 0; c < n.child_count; c++) {
+				aabb box;
+				if (n.prim_count[c] > 0) {
+					for (uint32_t p = 0; p < n.prim_count[c]; p++) {
+						box = aabb(box, primitives[n.child[c] + p]->bounding_box());
+					}
+				} else {
+					box = node_bounds(nodes[n.child[c]]);
+				}
+				set_child_box(n, c, box);
+			}
+		}
+		bbox = node_bounds(nodes[0]);
+	}
+
+	//front-to-back traversal; hit_prim(index, ray_t) tests one primitive and shrinks ray_t.max on a hit
+	template <typename PrimHit>
+	bool traverse(const ray& r, interval& ray_t, PrimHit&& hit_prim) const {
+		if (max_stack <= stack_capacity) {
+			stack_entry stack[stack_capacity];
+			return traverse_with_stack(r, ray_t, stack, hit_prim);
+		}
+		std::vector<stack_entry> stack(max_stack);
+		return traverse_with_stack(r, ray_t, stack.data(), hit_prim);
+	}
+
+	//packet traversal: children hit by any lane are visited front to back (closest entry of any lane)
+	//hit_prim(lane, index, lane_t) tests one primitive for one ray and shrinks lane_t.max on a hit
+	template <typename PacketPrimHit>
+	void traverse_packet(ray_packet& packet, interval* lane_t, PacketPrimHit&& hit_prim) const {
+		struct entry {
+			uint32_t ref;
+			uint32_t prim_count;
+			uint32_t mask;
+			float t_near;
+		};
+		entry fixed_stack[stack_capacity];
+		std::vector<entry> deep_stack;
+		entry* stack = fixed_stack;
+		if (max_stack > stack_capacity) {
+			deep_stack.resize(max_stack);
+			stack = deep_stack.data();
+		}
+
+		int stack_size = 0;
+		stack[stack_size++] = { 0, 0, packet.all_lanes(), -std::numeric_limits<float>::infinity() };
+		while (stack_size > 0) {
+			entry e = stack[--stack_size];
+
+			//skip the entry once every lane has a hit closer than its entry point
+			uint32_t mask = 0;
+			for (int lane = 0; lane < packet.size; lane++) {
+				if ((e.mask & (1u << lane)) && e.t_near <= packet.t_max[lane]) {
+					mask |= 1u << lane;
+				}
+			}
+			if (mask == 0) {
+				continue;
+			}
+
+			if (e.prim_count > 0) {
+				for (int lane = 0; lane < packet.size; lane++) {
+					if (!(mask & (1u << lane))) {
+						continue;
+					}
+					for (uint32_t i = 0; i < e.prim_count; i++) {
+						if (hit_prim(lane, e.ref + i, lane_t[lane])) {
+							packet.set_t_max(lane, lane_t[lane].max);
+						}
+					}
+				}
+				continue;
+			}
+
+			//sort the hit children far to near, so the nearest one is popped first
+			const node& n = nodes[e.ref];
+			entry hits[N];
+			int hit_count = 0;
+			for (int i = 0; i < n.child_count; i++) {
+				const float box_min[3] = { n.min_x[i], n.min_y[i], n.min_z[i] };
+				const float box_max[3] = { n.max_x[i], n.max_y[i], n.max_z[i] };
+				float t_near;
+				uint32_t child_mask = packet.box_hits(box_min, box_max, mask, t_near);
+				if (child_mask == 0) {
+					continue;
+				}
+				entry c = { n.child[i], n.prim_count[i], child_mask, t_near };
+				int j = hit_count++;
+				while (j > 0 && hits[j - 1].t_near < c.t_near) {
+					hits[j] = hits[j - 1];
+					j--;
+				}
+				hits[j] = c;
+			}
+			for (int i = 0; i < hit_count; i++) {
+				stack[stack_size++] = hits[i];
+			}
+		}
+	}
+
+	//wireframe traversal (BVH debug mode), levels are counted in wide nodes
+	//hit_prim has to fill rec, frames and volumes overwrite it
+	template <typename PrimHit>
+	bool traverse_debug(const ray& r, interval ray_t, hit_record& rec, PrimHit&& hit_prim) const {
+		struct entry {
+			uint32_t ref;
+			uint32_t prim_count;
+			int depth;
+			int debug_depth;
+			aabb box;
+		};
+		std::vector<entry> stack;
+		stack.push_back({ 0, 0, 0, -1, bbox });
+
+		bool hit_anything = false;
+		int hit_debug_depth = -1;
+
+		while (!stack.empty()) {
+			entry e = stack.back();
+			stack.pop_back();
+
+			interval box_t = ray_t;
+			if (!e.box.hit(r, box_t)) {
+				continue;
+			}
+
+			bool is_leaf = e.prim_count > 0;
+			int debug_depth = e.debug_depth;
+			if (bvh_debug::is_debug_level(is_leaf, e.depth)) {
+				double frame_t;
+				if (bvh_debug::hit_frame(e.box, r, box_t, frame_t)) {
+					bvh_debug::set_frame_hit(rec, r, frame_t, e.depth);
+					ray_t.max = frame_t;
+					hit_anything = true;
+					hit_debug_depth = -1;
+					continue;
+				}
+				debug_depth = e.depth;
+			}
+
+			if (is_leaf) {
+				for (uint32_t i = 0; i < e.prim_count; i++) {
+					if (hit_prim(e.ref + i, ray_t)) {
+						hit_anything = true;
+						hit_debug_depth = debug_depth;
+					}
+				}
+				continue;
+			}
+
+			const node& n = nodes[e.ref];
+			for (int i = 0; i < n.child_count; i++) {
+				stack.push_back({ n.child[i], n.prim_count[i], e.depth + 1, debug_depth, child_box(n, i) });
+			}
+		}
+
+		//volumes
+		if (hit_anything && hit_debug_depth >= 0) {
+			bvh_debug::set_volume_hit(rec, hit_debug_depth);
+		}
+		return hit_anything;
+	}
+
+private:
+	static constexpr int stack_capacity = 256;
+
+	//child reference waiting on the stack, t_near allows skipping it once a closer hit is found
+	struct stack_entry {
+		uint32_t ref;
+		uint32_t prim_count;
+		float t_near;
+	};
+
+	std::vector<node> nodes;
+	std::vector<const hittable*> primitives;
+	std::vector<shared_ptr<hittable>> owned;
+	aabb bbox;
+	int max_stack = 1;
+
+	//pull grandchildren up until the node has N children (largest surface area opened first)
+	static void collapse(const bvh_node& n, std::vector<const bvh_node*>& children) {
+		children = { n.left.get(), n.right.get() };
+		while (static_cast<int>(children.size()) < N) {
+			int best = -1;
+			double best_area = -1.0;
+			for (int i = 0; i < static_cast<int>(children.size()); i++) {
+				if (children[i]->left != nullptr && children[i]->bbox.surface_area() > best_area) {
+					best = i;
+					best_area = children[i]->bbox.surface_area();
+				}
+			}
+			if (best < 0) {
+				break;
+			}
+			const bvh_node* opened = children[best];
+			children[best] = opened->left.get();
+			children.push_back(opened->right.get());
+		}
+	}
+
+	void fill(uint32_t index, const std::vector<const bvh_node*>& children, int depth) {
+		//every level can leave N - 1 siblings on the stack
+		max_stack = std::max(max_stack, (depth + 1) * (N - 1) + 1);
+
+		for (int i = 0; i < N; i++) {
+			set_child_box(nodes[index], i, aabb());
+			nodes[index].child[i] = 0;
+			nodes[index].prim_count[i] = 0;
+		}
+		nodes[index].child_count = static_cast<uint8_t>(children.size());
+
+		for (int i = 0; i < static_cast<int>(children.size()); i++) {
+			const bvh_node* c = children[i];
+			set_child_box(nodes[index], i, c->bbox);
+
+			if (c->left == nullptr) {
+				nodes[index].child[i] = static_cast<uint32_t>(leaf_order.size());
+				nodes[index].prim_count[i] = static_cast<uint16_t>(c->indices.size());
+				leaf_order.insert(leaf_order.end(), c->indices.begin(), c->indices.end());
+				for (const auto& object : c->primitives) {
+					primitives.push_back(object.get());
+					owned.push_back(object);
+				}
+				continue;
+			}
+
+			//nodes may reallocate, keep working with indices
+			uint32_t child_index = static_cast<uint32_t>(nodes.size());
+			nodes.emplace_back();
+			nodes[index].child[i] = child_index;
+
+			std::vector<const bvh_node*> grandchildren;
+			collapse(*c, grandchildren);
+			fill(child_index, grandchildren, depth + 1);
+		}
+	}
+
+	static void set_child_box(node& n, int i, const aabb& box) {
+		if (box.x.min > box.x.max || box.y.min > box.y.max || box.z.min > box.z.max) {
+			n.min_x[i] = n.min_y[i] = n.min_z[i] = std::numeric_limits<float>::infinity();
+			n.max_x[i] = n.max_y[i] = n.max_z[i] = -std::numeric_limits<float>::infinity();
+			return;
+		}
+		n.min_x[i] = bvh_float::round_down(box.x.min);
+		n.min_y[i] = bvh_float::round_down(box.y.min);
+		n.min_z[i] = bvh_float::round_down(box.z.min);
+		n.max_x[i] = bvh_float::round_up(box.x.max);
+		n.max_y[i] = bvh_float::round_up(box.y.max);
+		n.max_z[i] = bvh_float::round_up(box.z.max);
+	}
+
+	static aabb node_bounds(const node& n) {
+		aabb box;
+		for (int c = 0; c < n.child_count; c++) {
+			box = aabb(box, child_box(n, c));
+		}
+		return box;
+	}
+
+	static aabb child_box(const node& n, int i) {
+		return aabb(interval(n.min_x[i], n.max_x[i]), interval(n.min_y[i], n.max_y[i]), interval(n.min_z[i], n.max_z[i]));
+	}
+
+	//slab test of all children, returns a bit mask of the hit ones and their entry distances
+	static int intersect_children(const node& n, const int* dir_neg, const wide_bvh_ray& rd, float t_min, float t_max, float* t_near) {
+		//near/far planes are picked per axis from the ray direction, no per-lane swaps needed
+		const float* near_planes[3] = {
+			dir_neg[0] ? n.max_x : n.min_x,
+			dir_neg[1] ? n.max_y : n.min_y,
+			dir_neg[2] ? n.max_z : n.min_z
+		};
+		const float* far_planes[3] = {
+			dir_neg[0] ? n.min_x : n.max_x,
+			dir_neg[1] ? n.min_y : n.max_y,
+			dir_neg[2] ? n.min_z : n.max_z
+		};
+		//float rounding of the distances (pbrt-style 1 + 2 * gamma(3) bound)
+		t_max *= 1.0f + 0x1p-21f;
+
+#if defined(ZENITH_WIDE_BVH_AVX)
+		if constexpr (N == 8) {
+			__m256 tn = _mm256_set1_ps(t_min);
+			__m256 tf = _mm256_set1_ps(t_max);
+			for (int a = 0; a < 3; a++) {
+				__m256 inv = _mm256_set1_ps(rd.inv_dir[a]);
+				__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(near_planes[a]), _mm256_set1_ps(rd.near_origin[a])), inv);
+				__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(far_planes[a]), _mm256_set1_ps(rd.far_origin[a])), inv);
+				//NaN (0 * inf on a plane through the origin) keeps the previous value
+				tn = _mm256_max_ps(t0, tn);
+				tf = _mm256_min_ps(t1, tf);
+			}
+			_mm256_storeu_ps(t_near, tn);
+			return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+		}
+#endif
+#if defined(ZENITH_WIDE_BVH_SSE)
+		int mask = 0;
+		for (int base = 0; base < N; base += 4) {
+			__m128 tn = _mm_set1_ps(t_min);
+			__m128 tf = _mm_set1_ps(t_max);
+			for (int a = 0; a < 3; a++) {
+				__m128 inv = _mm_set1_ps(rd.inv_dir[a]);
+				__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(near_planes[a] + base), _mm_set1_ps(rd.near_origin[a])), inv);
+				__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far_planes[a] + base), _mm_set1_ps(rd.far_origin[a])), inv);
+				tn = _mm_max_ps(t0, tn);
+				tf = _mm_min_ps(t1, tf);
+			}
+			_mm_storeu_ps(t_near + base, tn);
+			mask |= _mm_movemask_ps(_mm_cmple_ps(tn, tf)) << base;
+		}
+		return mask;
+#else
+		int mask = 0;
+		for (int i = 0; i < N; i++) {
+			float tn = t_min;
+			float tf = t_max;
+			for (int a = 0; a < 3; a++) {
+				float t0 = (near_planes[a][i] - rd.near_origin[a]) * rd.inv_dir[a];
+				float t1 = (far_planes[a][i] - rd.far_origin[a]) * rd.inv_dir[a];
+				tn = t0 > tn ? t0 : tn;
+				tf = t1 < tf ? t1 : tf;
+			}
+			t_near[i] = tn;
+			if (tn <= tf) {
+				mask |= 1 << i;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	template <typename PrimHit>
+	bool traverse_with_stack(const ray& r, interval& ray_t, stack_entry* stack, PrimHit& hit_prim) const {
+		wide_bvh_ray rd(r);
+		float t_min = bvh_float::round_down(ray_t.min);
+
+		bool hit_anything = false;
+		int stack_size = 0;
+		stack[stack_size++] = { 0, 0, t_min };
+
+		while (stack_size > 0) {
+			stack_entry e = stack[--stack_size];
+			if (e.t_near > ray_t.max) {
+				continue; //a closer hit was found after this child was pushed
+			}
+
+			if (e.prim_count > 0) {
+				for (uint32_t i = 0; i < e.prim_count; i++) {
+					if (hit_prim(e.ref + i, ray_t)) {
+						hit_anything = true;
+					}
+				}
+				continue;
+			}
+
+			const node& n = nodes[e.ref];
+			alignas(32) float t_near[N];
+			int mask = intersect_children(n, r.dir_neg, rd, t_min, bvh_float::round_up(ray_t.max), t_near);
+			if (mask == 0) {
+				continue;
+			}
+
+			//sort the hit children far to near, so the nearest one is popped first
+			stack_entry hits[N];
+			int hit_count = 0;
+			for (int i = 0; i < N; i++) {
+				if (mask & (1 << i)) {
+					stack_entry c = { n.child[i], n.prim_count[i], t_near[i] };
+					int j = hit_count++;
+					while (j > 0 && hits[j - 1].t_near < c.t_near) {
+						hits[j] = hits[j - 1];
+						j--;
+					}
+					hits[j] = c;
+				}
+			}
+			for (int i = 0; i < hit_count; i++) {
+				stack[stack_size++] = hits[i];
+			}
+		}
+		return hit_anything;
+	}
+};
+
+//flattened acceleration structure in the selected layout (the binary tree is only needed during the build)
+inline shared_ptr<flat_bvh> make_bvh_accelerator(const bvh_node& root, bvh_layout layout = global_settings::active_bvh_layout) {
+	switch (layout) {
+	case bvh_layout::WIDE_4:
+		return make_shared<wide_bvh<4>>(root);
+	case bvh_layout::WIDE_8:
+		return make_shared<wide_bvh<8>>(root);
+	default:
+		return make_shared<linear_bvh>(root);
+	}
+}
+
+inline const char* bvh_layout_name(bvh_layout layout) {
+	switch (layout) {
+	case bvh_layout::WIDE_4:
+		return "4-wide";
+	case bvh_layout::WIDE_8:
+		return "8-wide";
+	default:
+		return "Binary";
+	}
+}
\ No newline at end of file